@@ -0,0 +1,60 @@
+<?php
+/**
+ * Export results for offline analytics
+ *
+ * Usage:
+ *   php bin/export.php ndjson [--source=log|wishes] [--from=T] [--to=T] [--out=file]
+ *   php bin/export.php columnar --out=dir [--from=T] [--to=T]
+ * T is a timestamp prefix (2026-10, 2026-10-01, 2026-10-01T12); --to is inclusive.
+ * Add --game=type for a game other than the default.
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+require_once __DIR__ . '/../lib/logindex.php';
+require_once __DIR__ . '/../lib/segstore.php';
+require_once __DIR__ . '/../lib/wishindex.php';
+require_once __DIR__ . '/../lib/wishquery.php';
+require_once __DIR__ . '/../lib/games.php';
+require_once __DIR__ . '/../lib/export.php';
+
+$command = $argv[1] ?? '';
+$opts = getopt('', ['source:', 'from:', 'to:', 'out:', 'game:']);
+$paths = gamePaths(getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__), $opts['game'] ?? GAME_DEFAULT);
+$from = $opts['from'] ?? null;
+$to = $opts['to'] ?? null;
+$started = microtime(true);
+
+switch ($command) {
+    case 'ndjson':
+        $source = $opts['source'] ?? 'log';
+        $out = isset($opts['out']) ? fopen($opts['out'], 'wb') : STDOUT;
+        if ($source === 'log') {
+            $rows = exportLogNdjson($paths['log'], $paths['state'], $from, $to, $out);
+        } elseif ($source === 'wishes') {
+            $rows = exportWishesNdjson($paths['wishes'], $from, $to, $out);
+        } else {
+            fwrite(STDERR, "Unknown source: $source\n");
+            exit(1);
+        }
+        fwrite(STDERR, sprintf("Exported %d rows in %.2fs\n", $rows, microtime(true) - $started));
+        break;
+
+    case 'columnar':
+        if (empty($opts['out'])) {
+            fwrite(STDERR, "--out=dir is required\n");
+            exit(1);
+        }
+        list($files, $rows) = exportColumnar($paths['wishes'], $from, $to, $opts['out']);
+        fwrite(STDERR, sprintf("Wrote %d rows into %d segment files in %.2fs\n", $rows, $files, microtime(true) - $started));
+        break;
+
+    default:
+        fwrite(STDERR, "Usage: php bin/export.php ndjson|columnar [--source=log|wishes] [--from=T] [--to=T] [--out=path]\n");
+        exit(1);
+}
@@ -0,0 +1,69 @@
+<?php
+/**
+ * Wish filter benchmark: the previous regex filter against lib/contentfilter.php
+ * on ordinary and adversarial inputs. The filter's time per byte should stay
+ * flat as inputs grow; the regex's does not on the backtracking cases.
+ *
+ * Usage: php bin/filter_bench.php [--size=bytes] [--rounds=N] [--private=dir]
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/contentfilter.php';
+
+$opts = getopt('', ['size:', 'rounds:', 'private:']);
+$size = (int)($opts['size'] ?? 65536);
+$rounds = max(1, (int)($opts['rounds'] ?? 20));
+$privateDir = $opts['private'] ?? dirname(__DIR__) . '/private';
+
+$legacyPattern = '/<script|javascript:|on\w+\s*=|SELECT\s|INSERT\s|DELETE\s|DROP\s|UPDATE\s|UNION\s|eval\(|exec\(|system\(|\$\{|<\?|<%|\\\x/i';
+
+$inputs = [
+    'plain wish' => str_pad('', $size, 'I wish for a long and happy life with my family. '),
+    'handler prefix, no =' => 'on' . str_repeat('a', $size - 2),
+    'repeated "on"' => str_repeat('on', $size >> 1),
+    'handler + spaces, no =' => 'onx' . str_repeat(' ', $size - 3),
+    'near-miss keywords' => str_pad('', $size, 'selec inser delet dro updat unio <scrip javascript '),
+    'fullwidth + zero-width' => str_pad('', $size, "\u{FF53}\u{200B}\u{FF45}\u{FF4C} "),
+    'random bytes' => random_bytes($size)
+];
+
+// What a request pays to get the automaton: a fresh build against the cached include
+$config = @json_decode(@file_get_contents($privateDir . '/filter.json'), true);
+$config = is_array($config) ? $config + contentFilterDefaults() : contentFilterDefaults();
+$started = hrtime(true);
+for ($r = 0; $r < $rounds; $r++) {
+    contentFilterCompile($config['patterns'], !empty($config['event_handlers']));
+}
+$buildUs = (hrtime(true) - $started) / $rounds / 1000;
+$filter = contentFilterLoad($privateDir . '/filter.json');
+$cache = glob($privateDir . '/index/filter-*.php') ?: [];
+$started = hrtime(true);
+for ($r = 0; $r < $rounds && $cache; $r++) {
+    include $cache[0];
+}
+printf("automaton build %.1f us, cached include %s (opcache %s)\n\n", $buildUs,
+    $cache ? sprintf('%.1f us', (hrtime(true) - $started) / $rounds / 1000) : 'n/a',
+    function_exists('opcache_get_status') && @opcache_get_status(false) ? 'on' : 'off');
+
+printf("%-26s %14s %14s %8s\n", 'input (' . $size . ' bytes)', 'regex ns/B', 'filter ns/B', 'blocked');
+foreach ($inputs as $name => $text) {
+    ini_set('pcre.backtrack_limit', '100000000');
+    $started = hrtime(true);
+    for ($r = 0; $r < $rounds; $r++) {
+        preg_match($legacyPattern, $text);
+        preg_replace('/[^A-Za-z0-9 .,!?\'\"\n\r-]/', '', $text);
+    }
+    $regexNs = (hrtime(true) - $started) / $rounds / strlen($text);
+
+    $started = hrtime(true);
+    for ($r = 0; $r < $rounds; $r++) {
+        $result = contentFilter($filter, $text);
+    }
+    $filterNs = (hrtime(true) - $started) / $rounds / strlen($text);
+
+    printf("%-26s %14.1f %14.1f %8s\n", $name, $regexNs, $filterNs, $result['blocked'] ? 'yes' : 'no');
+}
@@ -0,0 +1,105 @@
+<?php
+/**
+ * Merge sampled profiles (lib/profiler.php) and render a flame graph
+ *
+ * Usage:
+ *   php bin/flamegraph.php [--from=YYYY-MM-DD] [--to=YYYY-MM-DD] [--entry=psychic_queue|credits]
+ *                          [--action=name] [--format=svg|collapsed] [--out=file] [--title=text]
+ * Days default to today. "collapsed" prints the merged stacks for
+ * flamegraph.pl or speedscope; "svg" (default) renders one standalone SVG.
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/profiler.php';
+
+define('FLAME_WIDTH', 1200);
+define('FLAME_FRAME', 16);
+define('FLAME_MIN_WIDTH', 0.5); // px; narrower frames are dropped
+
+$opts = getopt('', ['from:', 'to:', 'entry:', 'action:', 'format:', 'out:', 'title:']);
+$profileDir = (getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__)) . '/private/profiles';
+$from = $opts['from'] ?? date('Y-m-d');
+$to = $opts['to'] ?? $from;
+$pattern = sprintf('%s-%s.folded', $opts['entry'] ?? '*', $opts['action'] ?? '*');
+
+$files = [];
+foreach (glob($profileDir . '/*', GLOB_ONLYDIR) ?: [] as $dayDir) {
+    $day = basename($dayDir);
+    if ($day >= $from && $day <= $to) {
+        $files = array_merge($files, glob($dayDir . '/' . $pattern) ?: []);
+    }
+}
+$stacks = profilerMerge($files);
+if (!$stacks) {
+    fwrite(STDERR, "No samples for $pattern between $from and $to\n");
+    exit(1);
+}
+$out = isset($opts['out']) ? fopen($opts['out'], 'wb') : STDOUT;
+
+if (($opts['format'] ?? 'svg') === 'collapsed') {
+    ksort($stacks);
+    foreach ($stacks as $stack => $count) {
+        fwrite($out, "$stack $count\n");
+    }
+    exit(0);
+}
+
+// Frame tree: name => [value, children]
+$root = ['value' => 0, 'children' => []];
+foreach ($stacks as $stack => $count) {
+    $node = &$root;
+    $node['value'] += $count;
+    foreach (explode(';', $stack) as $frame) {
+        if (!isset($node['children'][$frame])) {
+            $node['children'][$frame] = ['value' => 0, 'children' => []];
+        }
+        $node = &$node['children'][$frame];
+        $node['value'] += $count;
+    }
+    unset($node);
+}
+
+function flameDepth($node) {
+    $depth = 0;
+    foreach ($node['children'] as $child) {
+        $depth = max($depth, 1 + flameDepth($child));
+    }
+    return $depth;
+}
+
+function flameColor($name) {
+    $h = crc32($name);
+    return sprintf('rgb(%d,%d,%d)', 205 + ($h & 0x31), 80 + (($h >> 8) & 0x7f), 40 + (($h >> 16) & 0x3f));
+}
+
+function flameRects($node, $x, $depth, $scale, $total, $height, &$svg) {
+    foreach ($node['children'] as $name => $child) {
+        $width = $child['value'] * $scale;
+        if ($width >= FLAME_MIN_WIDTH) {
+            $y = $height - ($depth + 1) * FLAME_FRAME - 20;
+            $label = htmlspecialchars($name, ENT_QUOTES | ENT_XML1);
+            $title = sprintf('%s (%d samples, %.2f%%)', $label, $child['value'], 100 * $child['value'] / $total);
+            $text = $width > 30 ? htmlspecialchars(mb_strimwidth($name, 0, (int)($width / 7), '..'), ENT_QUOTES | ENT_XML1) : '';
+            $svg .= sprintf('<g><title>%s</title><rect x="%.1f" y="%d" width="%.1f" height="%d" fill="%s" rx="2"/>'
+                . '<text x="%.1f" y="%d">%s</text></g>' . "\n",
+                $title, $x, $y, $width, FLAME_FRAME - 1, flameColor($name), $x + 3, $y + 11, $text);
+            flameRects($child, $x, $depth + 1, $scale, $total, $height, $svg);
+        }
+        $x += $width;
+    }
+}
+
+$height = (flameDepth($root) + 1) * FLAME_FRAME + 40;
+$title = htmlspecialchars($opts['title'] ?? "$pattern $from..$to", ENT_QUOTES | ENT_XML1);
+$svg = sprintf('<svg xmlns="http://www.w3.org/2000/svg" width="%d" height="%d" font-family="monospace" font-size="11">' . "\n",
+    FLAME_WIDTH, $height);
+$svg .= sprintf('<rect width="100%%" height="100%%" fill="#fdf6e3"/><text x="%d" y="16" text-anchor="middle" font-size="14">%s (%d samples)</text>' . "\n",
+    FLAME_WIDTH / 2, $title, $root['value']);
+flameRects($root, 0, 0, FLAME_WIDTH / $root['value'], $root['value'], $height, $svg);
+$svg .= "</svg>\n";
+fwrite($out, $svg);
+fwrite(STDERR, sprintf("%d stacks, %d samples from %d files\n", count($stacks), $root['value'], count($files)));
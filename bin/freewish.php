@@ -0,0 +1,42 @@
+<?php
+/**
+ * Carry today's free-wish claims from credits.json (free_used_date) into the
+ * claim bitmap, once, when switching to lib/freewish.php
+ *
+ * Usage: php bin/freewish.php import [--private=dir]
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+require_once __DIR__ . '/../lib/accountdict.php';
+require_once __DIR__ . '/../lib/freewish.php';
+
+$opts = getopt('', ['private:']);
+$privateDir = $opts['private'] ?? dirname(__DIR__) . '/private';
+
+if (($argv[1] ?? '') !== 'import') {
+    fwrite(STDERR, "Usage: php bin/freewish.php import [--private=dir]\n");
+    exit(1);
+}
+
+$credits = snapshotRead($privateDir . '/credits.json');
+if ($credits === null) {
+    fwrite(STDERR, "credits.json is unreadable\n");
+    exit(1);
+}
+
+$today = date('Y-m-d');
+$count = 0;
+foreach ($credits as $username => $record) {
+    if (($record['free_used_date'] ?? null) !== $today) continue;
+    $id = accountId($privateDir . '/index/accounts.dict', $username, true);
+    if ($id && freeClaim($privateDir . '/free', $today, $id) === true) {
+        $count++;
+    }
+}
+printf("Imported %d free-wish claims for %s\n", $count, $today);
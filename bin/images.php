@@ -0,0 +1,105 @@
+<?php
+/**
+ * Stage image pipeline: builds the Zoltarano hero image as AVIF, WebP and PNG
+ * at several widths under assets/stage/ and rewrites the <picture> block in
+ * index.html (between the stage-image markers) with srcset/sizes and the
+ * source's real dimensions. File names carry a hash of the source image, so
+ * they can be served with a far-future cache lifetime.
+ * Needs GD; AVIF is skipped when GD was built without it (PHP < 8.1).
+ *
+ * Usage: php bin/images.php [--source=url|file] [--widths=180,280,360,560] [--out=dir]
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+define('STAGE_IMAGE_SOURCE', 'https://ndao.org/arcade/games/Zoltarano_Speaks/ZOLTARANO.png');
+define('STAGE_IMAGE_SIZES', '(max-width: 480px) 180px, (max-width: 768px) 230px, 280px');
+
+$root = dirname(__DIR__);
+$opts = getopt('', ['source:', 'widths:', 'out:']);
+$source = $opts['source'] ?? STAGE_IMAGE_SOURCE;
+$widths = array_map('intval', explode(',', $opts['widths'] ?? '180,280,360,560'));
+$outDir = rtrim($opts['out'] ?? $root . '/assets/stage', '/');
+$indexFile = $root . '/index.html';
+
+if (!function_exists('imagecreatefromstring')) {
+    fwrite(STDERR, "The GD extension is required\n");
+    exit(1);
+}
+$data = @file_get_contents($source);
+$image = $data === false ? false : @imagecreatefromstring($data);
+if (!$image) {
+    fwrite(STDERR, "Cannot read image: $source\n");
+    exit(1);
+}
+if (!is_dir($outDir)) {
+    mkdir($outDir, 0755, true);
+}
+
+$sourceWidth = imagesx($image);
+$sourceHeight = imagesy($image);
+$hash = substr(hash('sha256', $data), 0, 8);
+$formats = ['png' => 'imagepng', 'webp' => 'imagewebp'];
+if (function_exists('imageavif')) {
+    $formats = ['avif' => 'imageavif'] + $formats;
+}
+
+$srcsets = [];
+sort($widths);
+foreach ($widths as $width) {
+    if ($width <= 0 || $width > $sourceWidth) continue;
+    $scaled = imagescale($image, $width, (int)round($sourceHeight * $width / $sourceWidth), IMG_BICUBIC);
+    imagealphablending($scaled, false);
+    imagesavealpha($scaled, true);
+    foreach ($formats as $ext => $encode) {
+        $name = sprintf('zoltarano-%s-%d.%s', $hash, $width, $ext);
+        switch ($ext) {
+            case 'avif': $encode($scaled, $outDir . '/' . $name, 60, 6); break;
+            case 'webp': $encode($scaled, $outDir . '/' . $name, 80); break;
+            default: $encode($scaled, $outDir . '/' . $name, 9);
+        }
+        $srcsets[$ext][] = 'assets/stage/' . $name . ' ' . $width . 'w';
+        printf("%-36s %8d bytes\n", $name, filesize($outDir . '/' . $name));
+    }
+    imagedestroy($scaled);
+}
+imagedestroy($image);
+if (!$srcsets) {
+    fwrite(STDERR, "No width fits the {$sourceWidth}px source\n");
+    exit(1);
+}
+
+// Display size 280px wide; width/height fix the aspect ratio before the image arrives
+$displayWidth = 280;
+$displayHeight = (int)round($sourceHeight * $displayWidth / $sourceWidth);
+$fallback = explode(' ', end($srcsets['png']))[0];
+foreach ($srcsets['png'] as $candidate) {
+    if ((int)explode(' ', $candidate)[1] >= $displayWidth) {
+        $fallback = explode(' ', $candidate)[0];
+        break;
+    }
+}
+
+$indent = str_repeat(' ', 24);
+$markup = $indent . "<picture>\n";
+foreach (['avif', 'webp'] as $ext) {
+    if (isset($srcsets[$ext])) {
+        $markup .= sprintf("%s    <source type=\"image/%s\" srcset=\"%s\" sizes=\"%s\">\n",
+            $indent, $ext, implode(', ', $srcsets[$ext]), STAGE_IMAGE_SIZES);
+    }
+}
+$markup .= sprintf("%s    <img src=\"%s\" srcset=\"%s\" sizes=\"%s\" width=\"%d\" height=\"%d\" fetchpriority=\"high\" decoding=\"async\" alt=\"Zoltarano\" class=\"zoltar-image\" id=\"crystalBall\">\n",
+    $indent, $fallback, implode(', ', $srcsets['png']), STAGE_IMAGE_SIZES, $displayWidth, $displayHeight);
+$markup .= $indent . "</picture>";
+
+$html = file_get_contents($indexFile);
+$html = preg_replace('/(<!-- stage-image -->\n).*?(\n[ \t]*<!-- \/stage-image -->)/s', '$1' . addcslashes($markup, '\\$') . '$2', $html, 1, $count);
+if ($count !== 1) {
+    fwrite(STDERR, "Stage image markers not found in index.html\n");
+    exit(1);
+}
+file_put_contents($indexFile, $html);
+printf("Updated index.html (%dx%d source, %d widths)\n", $sourceWidth, $sourceHeight, count($srcsets['png']));
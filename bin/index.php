@@ -0,0 +1,9 @@
+<?php
+/**
+ * Security: Block direct access to the CLI tools directory
+ * Maintenance scripts must be run from the command line
+ */
+
+http_response_code(403);
+header('Content-Type: text/plain');
+die('403 Forbidden - Access Denied');
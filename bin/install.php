@@ -0,0 +1,70 @@
+<?php
+/**
+ * One-time install / upgrade step: creates every directory and file the
+ * request handlers expect, so requests never check for or create them.
+ * Safe to re-run; run it again after adding a game to private/games.json.
+ *
+ * Usage: php bin/install.php [--data=dir]
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/games.php';
+require_once __DIR__ . '/../lib/bloom.php';
+
+$opts = getopt('', ['data:']);
+$dataDir = rtrim($opts['data'] ?? (getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__)), '/');
+$created = 0;
+
+function installDir($path, $mode) {
+    global $created;
+    if (!is_dir($path)) {
+        mkdir($path, $mode, true);
+        $created++;
+    }
+}
+
+function installFile($path, $contents) {
+    global $created;
+    if (!file_exists($path)) {
+        file_put_contents($path, $contents);
+        $created++;
+    }
+}
+
+installDir($dataDir . '/private', 0750);
+// Block directory listing/access
+installFile($dataDir . '/private/index.php', "<?php\nhttp_response_code(403);\ndie('403 Forbidden');\n");
+installDir($dataDir . '/private/free', 0750);
+
+foreach (gameTypes($dataDir) as $game) {
+    $paths = gamePaths($dataDir, $game);
+    installDir(dirname($paths['log']), 0755);
+    installDir($paths['private'], 0750);
+    foreach (['wishes', 'cube', 'hll'] as $key) {
+        installDir($paths[$key], 0750);
+    }
+    installDir(dirname($paths['state']), 0750);
+
+    $title = $game === GAME_DEFAULT ? 'Psychic Traveller Wish Game' : $game;
+    installFile($paths['log'], "# $title Log\n# Format: timestamp | user | result | tokens_won | memo | ~length:crc32\n# Wishes are stored privately\n\n");
+    installFile($paths['payout'], "# Payout Queue\n# Format: timestamp | queue_id | recipient | amount | memo | status | ~length:crc32\n\n");
+    // New games start from the shipped manifest (outcomes, packs, tokens); edit and bump its version to diverge
+    if (!file_exists($paths['config']) && file_exists(dirname(__DIR__) . '/game_config.json')) {
+        installFile($paths['config'], file_get_contents(dirname(__DIR__) . '/game_config.json'));
+    }
+    printf("%-24s ready\n", $game);
+}
+printf("Created %d directories and files under %s\n", $created, $dataDir);
+
+// Pending one-time migrations
+if (file_exists($dataDir . '/private/wishes.json')) {
+    echo "Legacy private/wishes.json found: run php bin/wishindex.php import\n";
+}
+$bloom = @file_get_contents($dataDir . '/private/index/accounts.bloom', false, null, 0, strlen(BLOOM_MAGIC) + 1);
+if ($bloom !== BLOOM_MAGIC . "\1") {
+    echo "Accounts filter not built yet: run php bin/rebuild.php\n";
+}
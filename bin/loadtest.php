@@ -0,0 +1,173 @@
+<?php
+/**
+ * Tail-latency load test under injected storage faults
+ * Each scenario installs a fresh data directory, starts `php -S` with
+ * PHP_CLI_SERVER_WORKERS workers and the scenario's ZOLTARAN_FAULTS (see
+ * lib/storage.php), and drives a mix of result logging, credit updates and
+ * leaderboard reads at a fixed concurrency. Reports p50/p99/p999 latency and
+ * the status/error breakdown per scenario. Graceful degradation means p999
+ * stays near the lock timeout and failures are 503s, not timeouts.
+ *
+ * Usage: php bin/loadtest.php [--requests=N] [--concurrency=N] [--workers=N]
+ *                             [--scenario=name,...] [--lock-timeout=MS] [--port=N]
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+
+define('LOADTEST_SCENARIOS', [
+    'baseline' => '',
+    'slow_fsync' => 'fsync_delay=50',
+    'slow_read' => 'read_delay=20',
+    'enospc' => 'enospc=0.2',
+    'lock_stall' => 'lock_stall=5000,lock_stall_p=0.02',
+    'partial_write' => 'partial=0.2'
+]);
+
+$opts = getopt('', ['requests:', 'concurrency:', 'workers:', 'scenario:', 'lock-timeout:', 'port:']);
+$requests = (int)($opts['requests'] ?? 2000);
+$concurrency = (int)($opts['concurrency'] ?? 16);
+$workers = (int)($opts['workers'] ?? 8);
+$lockTimeout = (int)($opts['lock-timeout'] ?? 500);
+$port = (int)($opts['port'] ?? 8931);
+$names = isset($opts['scenario']) ? explode(',', $opts['scenario']) : array_keys(LOADTEST_SCENARIOS);
+$root = dirname(__DIR__);
+
+if (!function_exists('curl_multi_init')) {
+    fwrite(STDERR, "The curl extension is required\n");
+    exit(1);
+}
+
+/**
+ * Start a server on a fresh, installed data directory; returns [process, dataDir]
+ */
+function loadtestServer($root, $port, $workers, $faults, $lockTimeout) {
+    $dataDir = sys_get_temp_dir() . '/zoltaran-loadtest-' . getmypid() . '-' . $port;
+    exec('rm -rf ' . escapeshellarg($dataDir));
+    mkdir($dataDir, 0750, true);
+    exec(PHP_BINARY . ' ' . escapeshellarg($root . '/bin/install.php') . ' --data=' . escapeshellarg($dataDir) . ' > /dev/null');
+
+    $env = getenv();
+    $env['ZOLTARAN_DATA_DIR'] = $dataDir;
+    $env['ZOLTARAN_FAULTS'] = $faults;
+    $env['ZOLTARAN_LOCK_TIMEOUT_MS'] = (string)$lockTimeout;
+    $env['PHP_CLI_SERVER_WORKERS'] = (string)$workers;
+    $process = proc_open([PHP_BINARY, '-S', '127.0.0.1:' . $port, '-t', $root],
+        [['file', '/dev/null', 'r'], ['file', '/dev/null', 'w'], ['file', '/dev/null', 'w']], $pipes, $root, $env);
+
+    // Wait for the listener
+    for ($i = 0; $i < 100; $i++) {
+        $socket = @fsockopen('127.0.0.1', $port, $errno, $errstr, 0.1);
+        if ($socket) {
+            fclose($socket);
+            break;
+        }
+        usleep(50000);
+    }
+    return [$process, $dataDir];
+}
+
+/**
+ * Request $n of the mix: 50% log_result, 20% credits add, 30% leaderboard
+ */
+function loadtestRequest($base, $n) {
+    $user = 'load' . (($n % 5) + 1);
+    $ch = curl_init();
+    $kind = $n % 10;
+    if ($kind < 5) {
+        curl_setopt($ch, CURLOPT_URL, $base . '/psychic_queue.php');
+        curl_setopt($ch, CURLOPT_POSTFIELDS, json_encode([
+            'action' => 'log_result', 'user' => $user, 'result_code' => 'TRY_AGAIN',
+            'tokens_won' => 0, 'wish' => 'load test wish ' . $n, 'memo' => 'LT' . $n
+        ]));
+        curl_setopt($ch, CURLOPT_HTTPHEADER, ['Content-Type: application/json']);
+    } elseif ($kind < 7) {
+        curl_setopt($ch, CURLOPT_URL, $base . '/credits.php');
+        curl_setopt($ch, CURLOPT_POSTFIELDS, http_build_query(['action' => 'add', 'username' => $user, 'amount' => 1]));
+    } else {
+        curl_setopt($ch, CURLOPT_URL, $base . '/psychic_queue.php?action=get_leaderboard');
+    }
+    curl_setopt($ch, CURLOPT_RETURNTRANSFER, true);
+    curl_setopt($ch, CURLOPT_TIMEOUT, 30);
+    return $ch;
+}
+
+function loadtestPercentile($sorted, $p) {
+    if (!$sorted) return 0;
+    return $sorted[min(count($sorted) - 1, (int)ceil($p * count($sorted)) - 1)];
+}
+
+printf("%d requests per scenario, concurrency %d, %d workers, lock timeout %d ms\n\n",
+    $requests, $concurrency, $workers, $lockTimeout);
+printf("%-14s %9s %9s %9s %9s %7s %7s %7s %7s\n", 'scenario', 'p50 ms', 'p99 ms', 'p999 ms', 'max ms', 'ok', '503', 'other', 'timeout');
+
+foreach ($names as $name) {
+    if (!isset(LOADTEST_SCENARIOS[$name])) {
+        fwrite(STDERR, "Unknown scenario: $name\n");
+        exit(1);
+    }
+    list($server, $dataDir) = loadtestServer($root, $port, $workers, LOADTEST_SCENARIOS[$name], $lockTimeout);
+    $base = 'http://127.0.0.1:' . $port;
+
+    $multi = curl_multi_init();
+    $started = [];
+    $latencies = [];
+    $counts = ['ok' => 0, '503' => 0, 'other' => 0, 'timeout' => 0];
+    $sent = 0;
+    $active = 0;
+    $wall = microtime(true);
+    while ($sent < $requests || $active > 0) {
+        while ($active < $concurrency && $sent < $requests) {
+            $ch = loadtestRequest($base, $sent++);
+            $started[(int)$ch] = hrtime(true);
+            curl_multi_add_handle($multi, $ch);
+            $active++;
+        }
+        curl_multi_exec($multi, $running);
+        curl_multi_select($multi, 0.01);
+        while ($done = curl_multi_info_read($multi)) {
+            $ch = $done['handle'];
+            $latencies[] = (hrtime(true) - $started[(int)$ch]) / 1e6;
+            $status = curl_getinfo($ch, CURLINFO_HTTP_CODE);
+            $body = json_decode((string)curl_multi_getcontent($ch), true);
+            if ($done['result'] !== CURLE_OK) {
+                $counts['timeout']++;
+            } elseif ($status === 503) {
+                $counts['503']++;
+            } elseif ($status === 200 && !empty($body['success'])) {
+                $counts['ok']++;
+            } else {
+                $counts['other']++;
+            }
+            curl_multi_remove_handle($multi, $ch);
+            curl_close($ch);
+            $active--;
+        }
+    }
+    curl_multi_close($multi);
+    $wall = microtime(true) - $wall;
+
+    // Torn records left behind would show up as corrupt lines in the log
+    $corrupt = 0;
+    foreach (@file($dataDir . '/log.txt') ?: [] as $line) {
+        if ($line[0] !== '#' && (substr($line, -1) !== "\n" || unframeRecord($line) === null)) {
+            $corrupt++;
+        }
+    }
+
+    sort($latencies);
+    printf("%-14s %9.1f %9.1f %9.1f %9.1f %7d %7d %7d %7d   %.0f req/s%s\n", $name,
+        loadtestPercentile($latencies, 0.5), loadtestPercentile($latencies, 0.99),
+        loadtestPercentile($latencies, 0.999), end($latencies) ?: 0,
+        $counts['ok'], $counts['503'], $counts['other'], $counts['timeout'],
+        count($latencies) / max($wall, 0.001), $corrupt ? ", $corrupt torn log lines" : '');
+
+    proc_terminate($server);
+    proc_close($server);
+    exec('rm -rf ' . escapeshellarg($dataDir));
+}
@@ -0,0 +1,82 @@
+<?php
+/**
+ * Index reader benchmark: stream (fopen/fseek/fread) against the FFI mapping
+ * of lib/mmap.php, on the request-path lookups: account dictionary probes,
+ * free-wish bitmap checks and Bloom filter probes. Each iteration is one
+ * request's worth: open (or map) the file, look up once, close (or unmap),
+ * since a request does only one to three lookups. Builds its own files in a
+ * temporary directory, so it never touches live data.
+ *
+ * Usage: php bin/mmap_bench.php [--accounts=N] [--lookups=N]
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/mmap.php';
+require_once __DIR__ . '/../lib/accountdict.php';
+require_once __DIR__ . '/../lib/freewish.php';
+require_once __DIR__ . '/../lib/bloom.php';
+
+$opts = getopt('', ['accounts:', 'lookups:']);
+$accounts = max(1, (int)($opts['accounts'] ?? 20000));
+$lookups = max(1, (int)($opts['lookups'] ?? 200000));
+$dir = sys_get_temp_dir() . '/zoltaran-mmap-bench-' . getmypid();
+mkdir($dir, 0750, true);
+
+function benchAccountName($i) {
+    return 'bench' . strtr(base_convert((string)$i, 10, 5), '01234', '12345');
+}
+
+// Fixture: dictionary, today's bitmap with every other account claimed, ready Bloom filter
+$dictFile = $dir . '/accounts.dict';
+$bloomFile = $dir . '/accounts.bloom';
+$filter = bloomEmpty();
+for ($i = 0; $i < $accounts; $i++) {
+    $name = benchAccountName($i);
+    $id = accountId($dictFile, $name, true);
+    if ($id % 2 === 0) {
+        freeClaim($dir, '2026-01-01', $id);
+    }
+    bloomLogAdd($filter, ['user' => $name], 0);
+}
+file_put_contents($bloomFile, str_pad(BLOOM_MAGIC . "\1", BLOOM_BLOCK, "\0") . $filter);
+
+$names = [];
+for ($i = 0; $i < $lookups; $i++) {
+    $names[] = benchAccountName(mt_rand(0, $accounts * 2)); // about half unknown
+}
+
+$cases = [
+    'accountId' => function($name) use ($dictFile) { return accountId($dictFile, $name); },
+    'freeClaimed' => function($name, $i) use ($dir, $accounts) { return freeClaimed($dir, '2026-01-01', $i % $accounts + 1); },
+    'bloomDefinitelyAbsent' => function($name) use ($bloomFile) { return bloomDefinitelyAbsent($bloomFile, $name); }
+];
+
+printf("FFI %s; %d accounts, %d lookups per case\n", mmapFfi() !== null ? 'available' : 'NOT available (both columns use streams)', $accounts, $lookups);
+printf("%-24s %14s %14s %9s\n", 'open+lookup+close', 'stream ns/op', 'mmap ns/op', 'speedup');
+foreach ($cases as $label => $fn) {
+    $results = [];
+    $ns = [];
+    foreach (['stream', 'auto'] as $mode) {
+        mmapMode($mode);
+        $out = [];
+        $started = hrtime(true);
+        foreach ($names as $i => $name) {
+            $out[] = $fn($name, $i);
+            mmapCloseAll(); // what the end of the request does
+        }
+        $ns[$mode] = (hrtime(true) - $started) / $lookups;
+        $results[$mode] = $out;
+    }
+    if ($results['stream'] !== $results['auto']) {
+        fwrite(STDERR, "$label: readers disagree\n");
+        exit(1);
+    }
+    printf("%-24s %14.0f %14.0f %8.1fx\n", $label, $ns['stream'], $ns['auto'], $ns['stream'] / max($ns['auto'], 1));
+}
+
+exec('rm -rf ' . escapeshellarg($dir));
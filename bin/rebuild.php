@@ -0,0 +1,167 @@
+<?php
+/**
+ * Parallel rebuild of derived log state (per-user stats, sparse index, rollup cube,
+ * distinct-player sketches, known-accounts filter)
+ * Splits log.txt at line boundaries, scans the ranges in worker processes
+ * and merges the partial aggregates in file order
+ *
+ * Usage: php bin/rebuild.php [--workers=N] [--game=type] [--log=path] [--private=dir]
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+require_once __DIR__ . '/../lib/logindex.php';
+require_once __DIR__ . '/../lib/cube.php';
+require_once __DIR__ . '/../lib/hll.php';
+require_once __DIR__ . '/../lib/bloom.php';
+require_once __DIR__ . '/../lib/backup.php';
+require_once __DIR__ . '/../lib/games.php';
+
+$opts = getopt('', ['workers:', 'log:', 'private:', 'game:', 'worker', 'start:', 'end:', 'out:']);
+$paths = gamePaths(getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__), $opts['game'] ?? GAME_DEFAULT);
+$logFile = $opts['log'] ?? $paths['log'];
+$privateDir = $opts['private'] ?? $paths['private'];
+$stateFile = $privateDir . '/index/log_state.json';
+$baseFile = $privateDir . '/index/log_base.dat';
+
+// Worker mode (proc_open fallback): scan one range and write the partial
+if (isset($opts['worker'])) {
+    $partial = logScanRange($logFile, (int)$opts['start'], (int)$opts['end'], null, true);
+    file_put_contents($opts['out'], serialize($partial));
+    exit(0);
+}
+
+if (!file_exists($logFile)) {
+    fwrite(STDERR, "Log not found: $logFile\n");
+    exit(1);
+}
+
+// Retention moves log offsets and the base file, and a restore replaces the log; neither may run meanwhile
+$maintenance = backupMaintenanceLock($privateDir);
+
+// Totals of lines that retention compacted out of the log
+$base = logLoadBase($baseFile, $logFile);
+if ($base === false) {
+    fwrite(STDERR, "$baseFile does not match the log (restored or replaced?); "
+        . "move it aside to rebuild from the log alone. Checkpoint left unchanged\n");
+    exit(1);
+}
+
+$workers = max(1, (int)($opts['workers'] ?? cpuCount()));
+$started = microtime(true);
+
+// Freeze the size up front, under the append lock so it never ends inside a line being
+// written. Readers pick up later lines as the checkpoint's tail; cubePublish() folds
+// them into each cube file under that file's lock.
+$fp = fopen($logFile, 'rb');
+flock($fp, LOCK_SH);
+$size = fstat($fp)['size'];
+flock($fp, LOCK_UN);
+fclose($fp);
+$ranges = logSplitRanges($logFile, $workers, $size);
+$partials = runWorkers($logFile, $ranges);
+
+if ($partials === null) {
+    fwrite(STDERR, "Worker failed, checkpoint left unchanged\n");
+    exit(1);
+}
+
+if ($base !== null) {
+    array_unshift($partials, $base);
+}
+$state = logMergePartials($partials, $logFile, true);
+
+// Published derivations go to their own stores; the rest form the checkpoint
+foreach (logDerivations() as $name => $fns) {
+    if ($fns[2] !== null) {
+        if ($fns[2]($state['derived'][$name], $privateDir, $logFile, $size) === false) {
+            fwrite(STDERR, "Failed to publish $name, checkpoint left unchanged\n");
+            exit(1);
+        }
+        unset($state['derived'][$name]);
+    }
+}
+if (!logSaveState($stateFile, $state)) {
+    fwrite(STDERR, "Failed to write $stateFile\n");
+    exit(1);
+}
+
+printf("Rebuilt %d lines (%d bytes) with %d workers in %.3fs\n",
+    $state['lines'], $state['log_offset'], count($ranges), microtime(true) - $started);
+
+/**
+ * Number of online CPUs (falls back to 1)
+ */
+function cpuCount() {
+    if (is_readable('/proc/cpuinfo')) {
+        $n = preg_match_all('/^processor\s*:/m', file_get_contents('/proc/cpuinfo'));
+        if ($n > 0) return $n;
+    }
+    $n = (int)@shell_exec('nproc 2>/dev/null');
+    return $n > 0 ? $n : 1;
+}
+
+/**
+ * Scan each range in its own process; returns partials in range order or null on failure
+ */
+function runWorkers($logFile, $ranges) {
+    if (count($ranges) <= 1) {
+        return array_map(function($r) use ($logFile) {
+            return logScanRange($logFile, $r[0], $r[1], null, true);
+        }, $ranges);
+    }
+
+    $tmpDir = sys_get_temp_dir();
+    $outs = [];
+    foreach ($ranges as $i => $r) {
+        $outs[$i] = tempnam($tmpDir, 'zrebuild');
+    }
+
+    if (function_exists('pcntl_fork')) {
+        $pids = [];
+        foreach ($ranges as $i => $r) {
+            $pid = pcntl_fork();
+            if ($pid === -1) {
+                return null;
+            }
+            if ($pid === 0) {
+                file_put_contents($outs[$i], serialize(logScanRange($logFile, $r[0], $r[1], null, true)));
+                exit(0);
+            }
+            $pids[$i] = $pid;
+        }
+        $ok = true;
+        foreach ($pids as $pid) {
+            pcntl_waitpid($pid, $status);
+            $ok = $ok && pcntl_wexitstatus($status) === 0;
+        }
+    } else {
+        $procs = [];
+        foreach ($ranges as $i => $r) {
+            $cmd = [PHP_BINARY, __FILE__, '--worker', '--log=' . $logFile,
+                '--start=' . $r[0], '--end=' . $r[1], '--out=' . $outs[$i]];
+            $procs[$i] = proc_open($cmd, [], $pipes);
+        }
+        $ok = true;
+        foreach ($procs as $proc) {
+            $ok = $ok && is_resource($proc) && proc_close($proc) === 0;
+        }
+    }
+
+    $partials = [];
+    foreach ($outs as $i => $out) {
+        $partial = $ok ? @unserialize(file_get_contents($out)) : false;
+        @unlink($out);
+        if (!is_array($partial)) {
+            $ok = false;
+            continue;
+        }
+        $partials[$i] = $partial;
+    }
+    return $ok ? $partials : null;
+}
@@ -0,0 +1,111 @@
+<?php
+/**
+ * Startup recovery after a crash or power loss
+ * Finishes an interrupted snapshot restore (lib/backup.php), then verifies
+ * only what was written since the last recovery checkpoint: the framed tails
+ * of log.txt and payout_queue.txt (a torn final record is cut off, complete
+ * lines failing their checksum are only reported), the uncommitted bytes of
+ * the active wish segment, and the credits snapshot (restored from
+ * credits.json.bak when it does not decode).
+ *
+ * Usage: php bin/recover.php [--full] [--game=type] [--private=dir]
+ * Covers one game's stores (default game unless --game); the shared credits
+ * snapshot is checked with the default game.
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+require_once __DIR__ . '/../lib/segstore.php';
+require_once __DIR__ . '/../lib/wishindex.php';
+require_once __DIR__ . '/../lib/wishquery.php';
+require_once __DIR__ . '/../lib/backup.php';
+require_once __DIR__ . '/../lib/games.php';
+
+$opts = getopt('', ['full', 'game:', 'private:']);
+$game = $opts['game'] ?? GAME_DEFAULT;
+$paths = gamePaths(getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__), $game);
+$privateDir = $opts['private'] ?? $paths['private'];
+$checkpointFile = $privateDir . '/index/recovery.json';
+$started = microtime(true);
+
+// A snapshot restore that committed but did not finish is completed first
+$creditsFile = $game === GAME_DEFAULT ? $privateDir . '/credits.json' : $paths['credits'];
+$restored = backupRestoreResume(dirname($paths['log']), $privateDir, $creditsFile);
+if ($restored !== null) {
+    printf("%-8s finished the interrupted restore of generation %d; run bin/rebuild.php\n", 'restore', $restored);
+}
+
+$checkpoint = isset($opts['full']) ? [] : (@json_decode(@file_get_contents($checkpointFile), true) ?: []);
+
+// Append-only text stores: resume from the checkpoint unless the file was replaced
+foreach (['log' => $paths['log'], 'payout' => $paths['payout']] as $name => $file) {
+    if (!file_exists($file)) continue;
+    clearstatcache(true, $file);
+    $inode = fileinode($file);
+    $same = ($checkpoint[$name]['inode'] ?? null) === $inode;
+    $offset = $same ? $checkpoint[$name]['offset'] : 0;
+    $report = frameRecoverTail($file, $offset, $same ? ($checkpoint[$name]['anchor'] ?? null) : null);
+    $checkpoint[$name] = ['inode' => $inode, 'offset' => $report['offset'], 'anchor' => $report['anchor']];
+    printf("%-8s verified=%d corrupt=%d truncated=%d\n", $name, $report['offset'] - $report['start'], $report['corrupt'], $report['truncated']);
+    foreach ($report['corrupt_at'] as $at) {
+        printf("%-8s checksum mismatch in the line at byte %d (left in place)\n", '', $at);
+    }
+}
+
+// Active wish segment: anything past head.json's committed length is a dead append
+$wishDir = $privateDir . '/wishes';
+if (is_dir($wishDir)) {
+    $lock = fopen($wishDir . '/.lock', 'c');
+    flock($lock, LOCK_EX);
+    $head = segLoadHead($wishDir);
+    $path = segPath($wishDir, $head['segment']);
+    $truncated = 0;
+    $corrupt = 0;
+    clearstatcache(true, $path);
+    if (file_exists($path)) {
+        if (filesize($path) > $head['bytes']) {
+            $truncated = filesize($path) - $head['bytes'];
+            $fp = fopen($path, 'r+');
+            ftruncate($fp, $head['bytes']);
+            fclose($fp);
+        }
+        $offset = ($checkpoint['wishes']['segment'] ?? null) === $head['segment'] ? $checkpoint['wishes']['offset'] : 0;
+        $fp = fopen($path, 'rb');
+        fseek($fp, min($offset, $head['bytes']));
+        while (($line = fgets($fp)) !== false) {
+            if (unframeRecord($line, "\t") === null) $corrupt++;
+        }
+        fclose($fp);
+    }
+    $checkpoint['wishes'] = ['segment' => $head['segment'], 'offset' => $head['bytes']];
+    flock($lock, LOCK_UN);
+    fclose($lock);
+    printf("%-8s corrupt=%d truncated=%d\n", 'wishes', $corrupt, $truncated);
+}
+
+// Credits snapshot: put the previous generation back if the current one is unreadable
+if ($game === GAME_DEFAULT && file_exists($creditsFile)) {
+    $current = json_decode(file_get_contents($creditsFile), true);
+    $status = 'ok';
+    if (!is_array($current)) {
+        // Copy rather than snapshotWrite so the good generation is not rotated out
+        $tmp = $creditsFile . '.' . getmypid() . '.tmp';
+        if (snapshotRead($creditsFile) !== null && copy($creditsFile . '.bak', $tmp) && rename($tmp, $creditsFile)) {
+            $status = 'restored from .bak';
+        } else {
+            $status = 'unrecoverable';
+        }
+    }
+    printf("%-8s %s\n", 'credits', $status);
+}
+
+if (!is_dir(dirname($checkpointFile))) {
+    mkdir(dirname($checkpointFile), 0750, true);
+}
+segWriteJson($checkpointFile, $checkpoint);
+printf("Recovery finished in %.3fs\n", microtime(true) - $started);
@@ -0,0 +1,86 @@
+<?php
+/**
+ * Replica applier: tails the primary's log.txt and keeps a local copy current
+ * for read-only nodes (get_leaderboard, get_stats, get_recent)
+ *
+ * Usage: php bin/replica.php --source=<primary dir | primary psychic_queue.php URL>
+ *            [--data=dir] [--game=type] [--interval=seconds] [--once]
+ * --data is the replica's game root (the ZOLTARAN_DATA_DIR its web server uses).
+ * URL sources need ZOLTARAN_ADMIN_TOKEN set to the primary's token.
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+require_once __DIR__ . '/../lib/logindex.php';
+require_once __DIR__ . '/../lib/bloom.php';
+require_once __DIR__ . '/../lib/replication.php';
+require_once __DIR__ . '/../lib/games.php';
+
+$opts = getopt('', ['source:', 'data:', 'game:', 'interval:', 'once']);
+if (empty($opts['source'])) {
+    fwrite(STDERR, "Usage: php bin/replica.php --source=<dir|url> [--data=dir] [--game=type] [--interval=seconds] [--once]\n");
+    exit(1);
+}
+$dataDir = rtrim($opts['data'] ?? (getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__)), '/');
+$interval = (float)($opts['interval'] ?? 0.5);
+$game = $opts['game'] ?? GAME_DEFAULT;
+$paths = gamePaths($dataDir, $game);
+$logFile = $paths['log'];
+$stateFile = $paths['state'];
+$bloomFile = $paths['bloom'];
+$statusFile = $paths['replica'];
+$maxBackoff = 30; // Seconds between retries of a chunk that keeps failing its checksum
+$retries = 0;
+
+foreach ([dirname($logFile), dirname($stateFile)] as $dir) {
+    if (!is_dir($dir)) {
+        mkdir($dir, 0750, true);
+    }
+}
+
+while (true) {
+    // Fetch until a chunk reaches the primary's end; the send time of that request bounds the lag
+    $caughtUp = false;
+    do {
+        clearstatcache(true, $logFile);
+        $offset = file_exists($logFile) ? filesize($logFile) : 0;
+        $sentAt = microtime(true);
+        $chunk = replFetch($opts['source'], $offset, $game);
+        if ($chunk === null) {
+            fwrite(STDERR, date('c') . " primary unreachable\n");
+            break;
+        }
+        $applied = replApply($logFile, $stateFile, $bloomFile, $chunk);
+        if ($applied === false) {
+            fwrite(STDERR, date('c') . " primary log diverged at $offset, resyncing\n");
+            replReset($logFile, $stateFile);
+            continue;
+        }
+        if ($applied === 0 && $chunk['data'] !== '') {
+            // Damaged in transit; back off rather than refetch in a tight loop
+            $retries++;
+            fwrite(STDERR, date('c') . " chunk at $offset failed its checksum, retry $retries\n");
+            usleep((int)(min($maxBackoff, max($interval, 0.1) * 2 ** min($retries, 16)) * 1000000));
+            continue;
+        }
+        $retries = 0;
+        $caughtUp = $chunk['offset'] + strlen($chunk['data']) >= $chunk['size'] && $applied === strlen($chunk['data']);
+    } while (!$caughtUp);
+
+    if ($chunk !== null && $caughtUp) {
+        replSaveStatus($statusFile, [
+            'source' => $opts['source'],
+            'offset' => $offset + $applied,
+            'primary_size' => $chunk['size'],
+            'caught_up_at' => $sentAt
+        ]);
+    }
+
+    if (isset($opts['once'])) break;
+    usleep((int)($interval * 1000000));
+}
@@ -0,0 +1,84 @@
+<?php
+/**
+ * Background retention and compaction job (run from cron, never from a request)
+ *
+ * Usage: php bin/retention.php [--dry-run] [--store=wishes,log,...] [--game=type] [--private=dir]
+ * Stores: wishes, log, payout, credits_history, hll_hours, cube_days, profiles
+ * Runs against one game's stores (default game unless --game); credits and
+ * profiles are shared by all games, so credits_history and profiles only run
+ * for the default game.
+ * Policies: see lib/retention.php, overridden by private/retention.json, e.g.
+ *   {"wishes": {"max_age_days": 180, "max_bytes": 2147483648}, "log": {"max_bytes": 536870912}}
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+require_once __DIR__ . '/../lib/logindex.php';
+require_once __DIR__ . '/../lib/cube.php';
+require_once __DIR__ . '/../lib/hll.php';
+require_once __DIR__ . '/../lib/bloom.php';
+require_once __DIR__ . '/../lib/segstore.php';
+require_once __DIR__ . '/../lib/wishindex.php';
+require_once __DIR__ . '/../lib/wishquery.php';
+require_once __DIR__ . '/../lib/retention.php';
+require_once __DIR__ . '/../lib/backup.php';
+require_once __DIR__ . '/../lib/games.php';
+
+$opts = getopt('', ['dry-run', 'store:', 'game:', 'private:']);
+$game = $opts['game'] ?? GAME_DEFAULT;
+$paths = gamePaths(getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__), $game);
+$privateDir = $opts['private'] ?? $paths['private'];
+$dryRun = isset($opts['dry-run']);
+$now = time();
+
+// Compaction replaces files; never while a snapshot is copying them
+$maintenance = backupMaintenanceLock($privateDir);
+$policies = retentionPolicies($privateDir);
+$stores = isset($opts['store']) ? explode(',', $opts['store']) : array_keys($policies);
+if ($game !== GAME_DEFAULT) {
+    $stores = array_values(array_diff($stores, ['credits_history', 'profiles']));
+}
+
+foreach ($stores as $store) {
+    if (!isset($policies[$store])) {
+        fwrite(STDERR, "Unknown store: $store\n");
+        exit(1);
+    }
+    $policy = $policies[$store];
+
+    switch ($store) {
+        case 'wishes':
+            $report = retentionWishes($privateDir . '/wishes', $policy, $now, $dryRun);
+            break;
+        case 'log':
+            $report = retentionLog($paths['log'], $privateDir . '/index/log_state.json',
+                $privateDir . '/index/log_base.dat', $privateDir . '/archive', $policy, $now, $dryRun);
+            break;
+        case 'payout':
+            $report = retentionPayout($paths['payout'], $policy, $now, $dryRun);
+            break;
+        case 'credits_history':
+            $report = retentionCreditsHistory($privateDir . '/credits.json', $policy, $now, $dryRun);
+            break;
+        case 'hll_hours':
+            $report = retentionHllHours($privateDir . '/hll', $policy, $now, $dryRun);
+            break;
+        case 'cube_days':
+            $report = retentionCubeDays($privateDir . '/cube', $policy, $now, $dryRun);
+            break;
+        case 'profiles':
+            $report = retentionProfiles($privateDir . '/profiles', $policy, $now, $dryRun);
+            break;
+    }
+
+    $parts = [];
+    foreach ($report as $key => $value) {
+        $parts[] = "$key=$value";
+    }
+    printf("%s%-16s %s\n", $dryRun ? '[dry-run] ' : '', $store, implode(' ', $parts));
+}
@@ -0,0 +1,69 @@
+<?php
+/**
+ * Online backup of credits, private wishes, log and payout queue
+ *
+ * Usage:
+ *   php bin/snapshot.php create [--keep=N] [--game=type] [--private=dir]   Take a new generation, keep the newest N
+ *   php bin/snapshot.php list [--game=type] [--private=dir]
+ *   php bin/snapshot.php restore <generation> [--game=type] [--private=dir]
+ * Each game has its own generations under its private directory; credits
+ * are shared and only captured with the default game.
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+require_once __DIR__ . '/../lib/segstore.php';
+require_once __DIR__ . '/../lib/wishindex.php';
+require_once __DIR__ . '/../lib/wishquery.php';
+require_once __DIR__ . '/../lib/backup.php';
+require_once __DIR__ . '/../lib/games.php';
+
+$command = $argv[1] ?? '';
+$opts = getopt('', ['keep:', 'game:', 'private:']);
+$game = $opts['game'] ?? GAME_DEFAULT;
+$paths = gamePaths(getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__), $game);
+$root = dirname($paths['log']);
+$privateDir = $opts['private'] ?? $paths['private'];
+$snapshotDir = $privateDir . '/snapshots';
+// Credits are shared; --private moves them only for the default game, which snapshots them
+$creditsFile = $game === GAME_DEFAULT ? $privateDir . '/credits.json' : $paths['credits'];
+
+switch ($command) {
+    case 'create':
+        $started = microtime(true);
+        $manifest = backupCreate($root, $privateDir, $creditsFile, $snapshotDir);
+        $bytes = array_sum(array_column($manifest['files'], 'bytes'));
+        printf("Generation %d: %d files, %.1f MB in %.2fs (writers held %.2f ms)\n",
+            $manifest['generation'], count($manifest['files']), $bytes / 1048576,
+            microtime(true) - $started, $manifest['lock_ms']);
+        if (isset($opts['keep'])) {
+            printf("Pruned %d old generations\n", backupPrune($snapshotDir, max(1, (int)$opts['keep'])));
+        }
+        break;
+
+    case 'list':
+        foreach (backupGenerations($snapshotDir) as $generation) {
+            $manifest = json_decode(@file_get_contents(backupPath($snapshotDir, $generation) . '/MANIFEST.json'), true);
+            printf("%6d  %s  %d files\n", $generation, $manifest['created'] ?? '?', count($manifest['files'] ?? []));
+        }
+        break;
+
+    case 'restore':
+        $result = backupRestore($root, $privateDir, $creditsFile, $snapshotDir, (int)($argv[2] ?? 0));
+        if (!$result['success']) {
+            fwrite(STDERR, $result['error'] . "\n");
+            exit(1);
+        }
+        printf("Restored generation %d taken %s\n", $result['generation'], $result['created']);
+        echo "Run php bin/rebuild.php --game=$game to rebuild the derived log state\n";
+        break;
+
+    default:
+        fwrite(STDERR, "Usage: php bin/snapshot.php create|list|restore <generation> [--keep=N] [--game=type] [--private=dir]\n");
+        exit(1);
+}
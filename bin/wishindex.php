@@ -0,0 +1,94 @@
+<?php
+/**
+ * Private wish store maintenance
+ *
+ * Usage:
+ *   php bin/wishindex.php import [--game=type] [--private=dir]   Move legacy private/wishes.json into segments
+ *   php bin/wishindex.php pending [--game=type] [--private=dir]  Index sealed segments that have no search index yet (cron)
+ *   php bin/wishindex.php reindex [--game=type] [--private=dir]  Rebuild the search index of every sealed segment
+ *   php bin/wishindex.php secondary [--game=type] [--private=dir] Rebuild the account and IP lists from all segments
+ */
+
+if (PHP_SAPI !== 'cli') {
+    http_response_code(403);
+    die('403 Forbidden');
+}
+
+require_once __DIR__ . '/../lib/storage.php';
+require_once __DIR__ . '/../lib/framing.php';
+require_once __DIR__ . '/../lib/segstore.php';
+require_once __DIR__ . '/../lib/wishindex.php';
+require_once __DIR__ . '/../lib/wishquery.php';
+require_once __DIR__ . '/../lib/games.php';
+
+$command = $argv[1] ?? '';
+$opts = getopt('', ['game:', 'private:']);
+$paths = gamePaths(getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__), $opts['game'] ?? GAME_DEFAULT);
+$privateDir = $opts['private'] ?? $paths['private'];
+$wishDir = $privateDir . '/wishes';
+
+switch ($command) {
+    case 'import':
+        $legacy = $privateDir . '/wishes.json';
+        $data = json_decode(@file_get_contents($legacy), true);
+        if (!is_array($data) || !isset($data['wishes'])) {
+            fwrite(STDERR, "No legacy wishes found at $legacy\n");
+            exit(1);
+        }
+        foreach ($data['wishes'] as $wish) {
+            segAppend($wishDir, $wish, ['seal' => 'wishBuildIndex', 'append' => 'wishIndexRecord']);
+        }
+        rename($legacy, $legacy . '.imported');
+        printf("Imported %d wishes into %s\n", count($data['wishes']), $wishDir);
+        break;
+
+    case 'pending':
+        // Sealed segments never change, so this runs without the append lock
+        $count = 0;
+        foreach (segLoadManifest($wishDir)['segments'] as $segment) {
+            if (!file_exists(segPath($wishDir, $segment['segment'], 'inv'))) {
+                wishBuildIndex($wishDir, $segment);
+                $count++;
+            }
+        }
+        printf("Indexed %d sealed segments\n", $count);
+        break;
+
+    case 'reindex':
+        $count = 0;
+        foreach (segLoadManifest($wishDir)['segments'] as $segment) {
+            wishBuildIndex($wishDir, $segment);
+            $count++;
+        }
+        printf("Reindexed %d sealed segments\n", $count);
+        break;
+
+    case 'secondary':
+        // Hold the append lock so the rebuilt lists match the segments exactly
+        $lock = fopen($wishDir . '/.lock', 'c');
+        flock($lock, LOCK_EX);
+        foreach (['user', 'ip'] as $kind) {
+            removeTree($wishDir . '/by_' . $kind);
+        }
+        $count = 0;
+        foreach (segList($wishDir) as $segment) {
+            segScan($wishDir, $segment['segment'], $segment['bytes'], function($record, $offset) use ($wishDir, $segment, &$count) {
+                wishIndexRecord($wishDir, $record, ['id' => $record['id'], 'segment' => $segment['segment'], 'offset' => $offset]);
+                $count++;
+            });
+        }
+        flock($lock, LOCK_UN);
+        printf("Indexed %d records by account and IP\n", $count);
+        break;
+
+    default:
+        fwrite(STDERR, "Usage: php bin/wishindex.php import|reindex|secondary [--game=type] [--private=dir]\n");
+        exit(1);
+}
+
+function removeTree($dir) {
+    foreach (glob($dir . '/*') ?: [] as $path) {
+        is_dir($path) ? removeTree($path) : unlink($path);
+    }
+    @rmdir($dir);
+}
@@ -13,27 +13,52 @@ if ($_SERVER['REQUEST_METHOD'] === 'OPTIONS') {
     exit(0);
 }
 
-$creditsFile = __DIR__ . '/private/credits.json';
+require_once __DIR__ . '/lib/bootstrap.php';
 
-// Ensure private directory exists
-if (!is_dir(__DIR__ . '/private')) {
-    mkdir(__DIR__ . '/private', 0750, true);
-}
+$creditsFile = $DATA_DIR . '/private/credits.json';
+$hllDir = $DATA_DIR . '/private/hll'; // Distinct-player sketches
+$bloomFile = $DATA_DIR . '/private/index/accounts.bloom'; // Accounts that ever played or bought credits
+$dictFile = $DATA_DIR . '/private/index/accounts.dict'; // Dense account ids for the free-wish bitmaps
+$freeDir = $DATA_DIR . '/private/free'; // One claim bitmap per day
+$velocityDir = $DATA_DIR . '/private/index'; // Request velocity sketches (lib/velocity.php)
 
-// Load existing credits
+// Load existing credits (falls back to the previous snapshot if the current one is damaged)
 function loadCredits() {
     global $creditsFile;
-    if (file_exists($creditsFile)) {
-        $data = json_decode(file_get_contents($creditsFile), true);
-        return is_array($data) ? $data : [];
+    $data = snapshotRead($creditsFile);
+    if ($data === null) {
+        // Never answer from (or save over) an unreadable store: that would wipe every balance
+        http_response_code(503);
+        echo json_encode(['success' => false, 'error' => 'Credits temporarily unavailable']);
+        exit;
     }
-    return [];
+    return $data;
 }
 
-// Save credits
+// Save credits as an atomic snapshot; a failed write leaves the previous one in place
 function saveCredits($credits) {
     global $creditsFile;
-    file_put_contents($creditsFile, json_encode($credits, JSON_PRETTY_PRINT));
+    if (!snapshotWrite($creditsFile, json_encode($credits, JSON_PRETTY_PRINT))) {
+        http_response_code(503);
+        header('Retry-After: 1');
+        echo json_encode(['success' => false, 'error' => 'Credits temporarily unavailable']);
+        exit;
+    }
+}
+
+// Serialize read-modify-write of the credits store (shared with bin/retention.php);
+// the lock is released when the request exits. Waits are bounded: a stuck
+// holder gets callers a quick 503 instead of a blocked worker each.
+function lockCredits() {
+    global $creditsFile;
+    $lock = fopen($creditsFile . '.lock', 'c');
+    if ($lock && !storeLock($lock, LOCK_EX)) {
+        http_response_code(503);
+        header('Retry-After: 1');
+        echo json_encode(['success' => false, 'error' => 'Credits busy, try again']);
+        exit;
+    }
+    return $lock;
 }
 
 // Validate username (Proton account format)
@@ -42,6 +67,8 @@ function isValidUsername($username) {
 }
 
 $action = $_GET['action'] ?? $_POST['action'] ?? '';
+profilerStart($DATA_DIR . '/private/profile.json', $DATA_DIR . '/private/profiles', 'credits', (string)$action,
+    ['get', 'add', 'use', 'use_free']);
 $username = $_GET['username'] ?? $_POST['username'] ?? '';
 
 // Validate username
@@ -50,22 +77,86 @@ if (!$username || !isValidUsername($username)) {
     exit;
 }
 
+// Count the account as active for this day and hour
+if (in_array($action, ['get', 'add', 'use', 'use_free'], true)) {
+    hllRecord($hllDir, $username);
+}
+
+$today = date('Y-m-d');
+
+// Spending a wish is where abuse costs something, so the velocity limits apply here,
+// before anything is charged: one address cycling through accounts, or one account
+// playing faster than a person can, is turned away
+if ($action === 'use' || $action === 'use_free') {
+    $limited = velocityLimit(velocityRecord($velocityDir, velocityClientIp(), $username));
+    if ($limited) {
+        http_response_code(429);
+        header('Retry-After: ' . $limited['retry_after']);
+        echo json_encode(['success' => false, 'error' => $limited['error']]);
+        exit;
+    }
+}
+
+// The daily free wish is one bit in today's bitmap; the credits store is never read
+if ($action === 'use_free') {
+    $accountId = accountId($dictFile, $username, true);
+    if ($accountId === false) {
+        http_response_code(503);
+        header('Retry-After: 1');
+        echo json_encode(['success' => false, 'error' => 'Credits busy, try again']);
+    } elseif ($accountId === null) {
+        echo json_encode(['success' => false, 'error' => 'Account registry full']);
+    } elseif (($claimed = freeClaim($freeDir, $today, $accountId)) === null) {
+        http_response_code(503);
+        header('Retry-After: 1');
+        echo json_encode(['success' => false, 'error' => 'Credits busy, try again']);
+    } elseif (!$claimed) {
+        echo json_encode(['success' => false, 'error' => 'Free wish already used today']);
+    } else {
+        echo json_encode(['success' => true, 'free_available' => false]);
+    }
+    exit;
+}
+
+if ($action === 'get') {
+    $accountId = accountId($dictFile, $username);
+    $freeAvailable = $accountId === null || !freeClaimed($freeDir, $today, $accountId);
+    // use_free leaves credits.json alone; its claim time stands in for last_updated
+    $freeClaimedAt = $accountId ? freeClaimTime($freeDir, $today, $accountId) : null;
+    $freeClaimedAt = $freeClaimedAt !== null ? date('c', $freeClaimedAt) : null;
+}
+
+// Unknown accounts have no stored credits; answer without decoding the store
+if ($action === 'get' && bloomDefinitelyAbsent($bloomFile, $username)) {
+    echo json_encode([
+        'success' => true,
+        'wishes' => 0,
+        'free_available' => $freeAvailable,
+        'last_updated' => $freeClaimedAt
+    ]);
+    exit;
+}
+
+if (in_array($action, ['add', 'use'], true)) {
+    $creditsLock = lockCredits();
+}
+
 $credits = loadCredits();
 
 switch ($action) {
     case 'get':
         // Get current credits for user
-        $userCredits = $credits[$username] ?? ['wishes' => 0, 'free_used_date' => null];
-
-        // Check if free wish is available today
-        $today = date('Y-m-d');
-        $freeAvailable = ($userCredits['free_used_date'] !== $today);
+        $userCredits = $credits[$username] ?? ['wishes' => 0];
+        $lastUpdated = $userCredits['last_updated'] ?? null;
+        if ($freeClaimedAt !== null && ($lastUpdated === null || strtotime($freeClaimedAt) > strtotime($lastUpdated))) {
+            $lastUpdated = $freeClaimedAt;
+        }
 
         echo json_encode([
             'success' => true,
             'wishes' => (int)$userCredits['wishes'],
             'free_available' => $freeAvailable,
-            'last_updated' => $userCredits['last_updated'] ?? null
+            'last_updated' => $lastUpdated
         ]);
         break;
 
@@ -80,7 +171,14 @@ switch ($action) {
         }
 
         if (!isset($credits[$username])) {
-            $credits[$username] = ['wishes' => 0, 'free_used_date' => null, 'history' => []];
+            // Unrecorded accounts are answered as empty by 'get', so the filter must have it first
+            if (!bloomAdd($bloomFile, $username)) {
+                http_response_code(503);
+                header('Retry-After: 1');
+                echo json_encode(['success' => false, 'error' => 'Credits busy, try again']);
+                exit;
+            }
+            $credits[$username] = ['wishes' => 0, 'history' => []];
         }
 
         $credits[$username]['wishes'] += $amount;
@@ -93,11 +191,6 @@ switch ($action) {
             'ip' => getClientIP()
         ];
 
-        // Keep history manageable
-        if (count($credits[$username]['history']) > 100) {
-            $credits[$username]['history'] = array_slice($credits[$username]['history'], -100);
-        }
-
         saveCredits($credits);
 
         echo json_encode([
@@ -130,34 +223,6 @@ switch ($action) {
         ]);
         break;
 
-    case 'use_free':
-        // Use free daily wish
-        $today = date('Y-m-d');
-
-        if (!isset($credits[$username])) {
-            $credits[$username] = ['wishes' => 0, 'free_used_date' => null, 'history' => []];
-        }
-
-        if ($credits[$username]['free_used_date'] === $today) {
-            echo json_encode(['success' => false, 'error' => 'Free wish already used today']);
-            exit;
-        }
-
-        $credits[$username]['free_used_date'] = $today;
-        $credits[$username]['last_updated'] = date('c');
-        $credits[$username]['history'][] = [
-            'action' => 'free',
-            'timestamp' => date('c')
-        ];
-
-        saveCredits($credits);
-
-        echo json_encode([
-            'success' => true,
-            'free_available' => false
-        ]);
-        break;
-
     default:
         echo json_encode(['success' => false, 'error' => 'Invalid action']);
 }
@@ -0,0 +1,109 @@
+<?php
+/**
+ * Account name dictionary: dense ids (1, 2, 3, ...) for account names
+ * private/index/accounts.dict is a fixed-size open-addressing table:
+ *   header  16 bytes: magic "ZDICT1\0\0", next id (uint32 BE), reserved
+ *   slots   ACCOUNT_DICT_SLOTS x 12 bytes: packed name (uint64 BE), id (uint32 BE)
+ * Names are packed the way Proton/EOSIO packs account names (5 bits per
+ * character, 12 characters in 60 bits), so a slot holds the whole name. Id 0
+ * marks an empty slot. Lookups read one or a few slots without locking;
+ * inserts take an exclusive lock on the file. The table is created sparse.
+ */
+
+define('ACCOUNT_DICT_MAGIC', "ZDICT1\0\0");
+define('ACCOUNT_DICT_HEADER', 16);
+define('ACCOUNT_DICT_SLOT', 12);
+define('ACCOUNT_DICT_SLOTS', 1 << 21); // 2M accounts, 24 MB when full
+
+/**
+ * 60-bit packed form of a valid account name ([a-z1-5.]{1,12})
+ */
+function accountPack($name) {
+    $value = 0;
+    for ($i = 0; $i < 12; $i++) {
+        $c = $name[$i] ?? '.';
+        if ($c === '.') {
+            $v = 0;
+        } elseif ($c >= '1' && $c <= '5') {
+            $v = ord($c) - ord('1') + 1;
+        } else {
+            $v = ord($c) - ord('a') + 6;
+        }
+        $value = ($value << 5) | $v;
+    }
+    return $value;
+}
+
+function accountDictSlot($packed) {
+    return hexdec(hash('crc32b', pack('J', $packed))) & (ACCOUNT_DICT_SLOTS - 1);
+}
+
+/**
+ * Dense id of an account, or null if it has none (and $create is false) or
+ * the table is full; false when the dictionary could not be opened or locked
+ */
+function accountId($file, $name, $create = false) {
+    $packed = accountPack($name);
+    if (!$create) {
+        return accountLookup($file, $packed);
+    }
+    $fp = @fopen($file, 'c+b');
+    if (!$fp) {
+        @mkdir(dirname($file), 0750, true);
+        $fp = @fopen($file, 'c+b');
+    }
+    if (!$fp) return false;
+    if (!storeLock($fp, LOCK_EX)) {
+        fclose($fp);
+        return false;
+    }
+    if (fstat($fp)['size'] < ACCOUNT_DICT_HEADER) {
+        fwrite($fp, ACCOUNT_DICT_MAGIC . pack('NN', 1, 0));
+    }
+
+    $id = null;
+    $slot = accountDictSlot($packed);
+    for ($probe = 0; $probe < ACCOUNT_DICT_SLOTS; $probe++) {
+        $pos = ACCOUNT_DICT_HEADER + $slot * ACCOUNT_DICT_SLOT;
+        fseek($fp, $pos);
+        $raw = fread($fp, ACCOUNT_DICT_SLOT);
+        $entry = strlen($raw) === ACCOUNT_DICT_SLOT ? unpack('Jname/Nid', $raw) : ['name' => 0, 'id' => 0];
+        if ($entry['id'] !== 0 && $entry['name'] === $packed) {
+            $id = $entry['id'];
+            break;
+        }
+        if ($entry['id'] === 0) {
+            fseek($fp, 8);
+            $id = unpack('N', fread($fp, 4))[1];
+            fseek($fp, $pos);
+            fwrite($fp, pack('JN', $packed, $id));
+            fseek($fp, 8);
+            fwrite($fp, pack('N', $id + 1));
+            fflush($fp);
+            break;
+        }
+        $slot = ($slot + 1) & (ACCOUNT_DICT_SLOTS - 1);
+    }
+
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return $id;
+}
+
+/**
+ * Unlocked lookup through the shared mapping (lib/mmap.php)
+ */
+function accountLookup($file, $packed) {
+    $map = mmapOpen($file);
+    if (!$map) return null;
+    $slot = accountDictSlot($packed);
+    for ($probe = 0; $probe < ACCOUNT_DICT_SLOTS; $probe++) {
+        $raw = mmapRead($map, ACCOUNT_DICT_HEADER + $slot * ACCOUNT_DICT_SLOT, ACCOUNT_DICT_SLOT);
+        if (strlen($raw) !== ACCOUNT_DICT_SLOT) return null;
+        $entry = unpack('Jname/Nid', $raw);
+        if ($entry['id'] === 0) return null;
+        if ($entry['name'] === $packed) return $entry['id'];
+        $slot = ($slot + 1) & (ACCOUNT_DICT_SLOTS - 1);
+    }
+    return null;
+}
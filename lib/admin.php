@@ -0,0 +1,31 @@
+<?php
+/**
+ * Operator authentication for admin actions
+ * The token is configured through the ZOLTARAN_ADMIN_TOKEN environment variable;
+ * when it is unset every admin action is refused.
+ */
+
+/**
+ * Token presented by the client (X-Admin-Token header, falling back to the request body)
+ */
+function adminTokenFromRequest($input) {
+    return $_SERVER['HTTP_X_ADMIN_TOKEN'] ?? ($input['admin_token'] ?? '');
+}
+
+function isAdmin($input) {
+    $expected = (string)getenv('ZOLTARAN_ADMIN_TOKEN');
+    $given = (string)adminTokenFromRequest($input);
+    return $expected !== '' && $given !== '' && hash_equals($expected, $given);
+}
+
+/**
+ * Reject the request unless it carries the admin token
+ */
+function requireAdmin($input) {
+    if (isAdmin($input)) {
+        return true;
+    }
+    http_response_code(403);
+    echo json_encode(['success' => false, 'error' => 'Forbidden']);
+    return false;
+}
@@ -0,0 +1,353 @@
+<?php
+/**
+ * Online snapshots of the primary stores (credits, private wishes, log, payouts)
+ *   private/snapshots/gen-000001/MANIFEST.json   generation, time, file lengths
+ *   private/snapshots/gen-000001/<path>          files relative to the game root
+ * A snapshot holds every writer lock at once only to record lengths, read the
+ * wish manifest/head and link credits.json (replaced by rename, never modified).
+ * Sealed wish segments and their .inv files are immutable and hard-linked, and
+ * the append-only tails are copied up to the recorded lengths after the locks
+ * are released. The log's base file (private/index/log_base.dat, totals of
+ * compacted lines) is linked with credits.json. The distinct-player sketches
+ * (private/hll) are copied after the locks too: they cannot be rebuilt for
+ * compacted log lines or for players seen only by credits.php, and since
+ * registers only grow a copy taken a moment late merely counts a few more
+ * players. Other derived state (private/index, cube, account/IP lists) is
+ * left out: a restore rebuilds the account/IP lists itself, drops the rest,
+ * and bin/rebuild.php rebuilds it.
+ * Hard links need private/snapshots on the same filesystem as private/.
+ */
+
+define('BACKUP_VERSION', 1);
+
+/**
+ * Exclusive lock shared by the maintenance jobs that replace files (retention
+ * compaction, restores), read them outside the writer locks (snapshots) or
+ * rebuild from them (bin/rebuild.php)
+ */
+function backupMaintenanceLock($privateDir) {
+    if (!is_dir($privateDir . '/index')) {
+        mkdir($privateDir . '/index', 0750, true);
+    }
+    $lock = fopen($privateDir . '/index/maintenance.lock', 'c');
+    flock($lock, LOCK_EX);
+    return $lock;
+}
+
+/**
+ * Writer locks in a fixed order: credits, wish store, log, payout queue
+ * $creditsFile is the shared credits store whose lock credits.php takes, for
+ * every game. $mode is LOCK_SH (appenders wait, readers don't) or LOCK_EX
+ */
+function backupLockAll($root, $privateDir, $creditsFile, $mode) {
+    $locks = [];
+    foreach ([$creditsFile . '.lock', $privateDir . '/wishes/.lock'] as $path) {
+        if (is_dir(dirname($path)) && ($fp = fopen($path, 'c'))) {
+            flock($fp, LOCK_EX);
+            $locks[] = $fp;
+        }
+    }
+    foreach ([$root . '/log.txt', $root . '/payout_queue.txt'] as $path) {
+        if ($fp = @fopen($path, 'r+')) {
+            flock($fp, $mode);
+            $locks[$path] = $fp;
+        }
+    }
+    return $locks;
+}
+
+function backupUnlockAll($locks) {
+    foreach ($locks as $fp) {
+        flock($fp, LOCK_UN);
+        fclose($fp);
+    }
+}
+
+/**
+ * Copy every file under $src to $dst, recording them as $rel/... in $files
+ */
+function backupCopyTree($src, $dst, $rel, &$files) {
+    foreach (glob($src . '/*') ?: [] as $path) {
+        $name = basename($path);
+        if (is_dir($path)) {
+            backupCopyTree($path, $dst . '/' . $name, $rel . '/' . $name, $files);
+            continue;
+        }
+        if (!is_dir($dst)) {
+            mkdir($dst, 0750, true);
+        }
+        if (copy($path, $dst . '/' . $name)) {
+            $files[$rel . '/' . $name] = ['bytes' => filesize($dst . '/' . $name), 'how' => 'copy'];
+        }
+    }
+}
+
+function backupCopyPrefix($src, $dst, $bytes) {
+    $in = fopen($src, 'rb');
+    $out = fopen($dst, 'wb');
+    $copied = stream_copy_to_stream($in, $out, $bytes);
+    fclose($in);
+    fclose($out);
+    return $copied === $bytes;
+}
+
+function backupGenerations($snapshotDir) {
+    $generations = [];
+    foreach (glob($snapshotDir . '/gen-*', GLOB_ONLYDIR) ?: [] as $path) {
+        if (preg_match('/gen-(\d+)$/', $path, $m)) {
+            $generations[] = (int)$m[1];
+        }
+    }
+    sort($generations);
+    return $generations;
+}
+
+function backupPath($snapshotDir, $generation) {
+    return sprintf('%s/gen-%06d', $snapshotDir, $generation);
+}
+
+/**
+ * Take a snapshot; returns its manifest
+ */
+function backupCreate($root, $privateDir, $creditsFile, $snapshotDir) {
+    $maintenance = backupMaintenanceLock($privateDir);
+    $generation = (backupGenerations($snapshotDir) ?: [0]);
+    $generation = end($generation) + 1;
+    $target = backupPath($snapshotDir, $generation);
+    $staging = $target . '.tmp';
+    mkdir($staging . '/private/wishes', 0750, true);
+
+    $manifest = ['version' => BACKUP_VERSION, 'generation' => $generation, 'created' => date('c'), 'files' => []];
+    $wishDir = $privateDir . '/wishes';
+
+    // Consistent cut: every store is captured at the same instant
+    $started = microtime(true);
+    $locks = backupLockAll($root, $privateDir, $creditsFile, LOCK_SH);
+    if (file_exists($privateDir . '/credits.json')) {
+        link($privateDir . '/credits.json', $staging . '/private/credits.json');
+        $manifest['files']['private/credits.json'] = ['bytes' => filesize($privateDir . '/credits.json'), 'how' => 'link'];
+    }
+    if (file_exists($privateDir . '/index/log_base.dat')) {
+        mkdir($staging . '/private/index', 0750, true);
+        link($privateDir . '/index/log_base.dat', $staging . '/private/index/log_base.dat');
+        $manifest['files']['private/index/log_base.dat'] = ['bytes' => filesize($privateDir . '/index/log_base.dat'), 'how' => 'link'];
+    }
+    $wishManifest = segLoadManifest($wishDir);
+    $wishHead = segLoadHead($wishDir);
+    $tails = [];
+    foreach (['log.txt', 'payout_queue.txt'] as $name) {
+        if (isset($locks[$root . '/' . $name])) {
+            $tails[$name] = fstat($locks[$root . '/' . $name])['size'];
+        }
+    }
+    backupUnlockAll($locks);
+    $manifest['lock_ms'] = round((microtime(true) - $started) * 1000, 2);
+
+    foreach ($wishManifest['segments'] as $segment) {
+        foreach (['log', 'inv'] as $ext) {
+            $path = segPath($wishDir, $segment['segment'], $ext);
+            if (file_exists($path)) {
+                $rel = 'private/wishes/' . basename($path);
+                link($path, $staging . '/' . $rel);
+                $manifest['files'][$rel] = ['bytes' => filesize($path), 'how' => 'link'];
+            }
+        }
+    }
+    $active = segPath($wishDir, $wishHead['segment']);
+    if ($wishHead['bytes'] > 0 && file_exists($active)) {
+        $rel = 'private/wishes/' . basename($active);
+        backupCopyPrefix($active, $staging . '/' . $rel, $wishHead['bytes']);
+        $manifest['files'][$rel] = ['bytes' => $wishHead['bytes'], 'how' => 'copy'];
+    }
+    segWriteJson($staging . '/private/wishes/manifest.json', $wishManifest);
+    segWriteJson($staging . '/private/wishes/head.json', $wishHead);
+
+    foreach ($tails as $name => $bytes) {
+        backupCopyPrefix($root . '/' . $name, $staging . '/' . $name, $bytes);
+        $manifest['files'][$name] = ['bytes' => $bytes, 'how' => 'copy'];
+    }
+    backupCopyTree($privateDir . '/hll', $staging . '/private/hll', 'private/hll', $manifest['files']);
+
+    file_put_contents($staging . '/MANIFEST.json', json_encode($manifest, JSON_PRETTY_PRINT));
+    rename($staging, $target);
+
+    flock($maintenance, LOCK_UN);
+    fclose($maintenance);
+    return $manifest;
+}
+
+/**
+ * Put a snapshot back as one unit
+ * The whole generation is staged under private/restore/ first: copies of the
+ * log, payout queue, credits and log base, the wish store files that differ
+ * from the live ones, and account/IP lists built from the snapshot's
+ * segments. Then, under all writer locks, restore/JOURNAL.json is written by
+ * rename; that rename is the commit point. The journal lists the live files
+ * to delete (wish segments the snapshot lacks, every derived store) and the
+ * renames that move the staged files into place. A crash before it leaves
+ * the live stores untouched; a crash after it is rolled forward by
+ * backupRestoreResume() (the next restore or bin/recover.php).
+ * log.txt and payout_queue.txt are replaced by rename; storeAppend() notices
+ * when the file it locked is no longer the one at its path and reopens.
+ */
+function backupRestore($root, $privateDir, $creditsFile, $snapshotDir, $generation) {
+    $source = backupPath($snapshotDir, $generation);
+    $manifest = json_decode(@file_get_contents($source . '/MANIFEST.json'), true);
+    if (!is_array($manifest) || ($manifest['version'] ?? 0) !== BACKUP_VERSION) {
+        return ['success' => false, 'error' => "No snapshot generation $generation"];
+    }
+    foreach ($manifest['files'] as $rel => $file) {
+        clearstatcache(true, $source . '/' . $rel);
+        if (@filesize($source . '/' . $rel) !== $file['bytes']) {
+            return ['success' => false, 'error' => "Snapshot file damaged: $rel"];
+        }
+    }
+
+    $maintenance = backupMaintenanceLock($privateDir);
+    backupRestoreResume($root, $privateDir, $creditsFile);
+
+    $staging = $privateDir . '/restore';
+    $wishDir = $privateDir . '/wishes';
+    $sourceWishes = $source . '/private/wishes';
+    mkdir($staging . '/wishes', 0750, true);
+    $journal = ['generation' => $generation, 'remove' => [], 'moves' => []];
+
+    // Sealed segments are identical to the live ones (same inode) unless retention dropped them
+    foreach ($manifest['files'] as $rel => $file) {
+        if (strpos($rel, 'private/wishes/') !== 0) continue;
+        $live = $wishDir . '/' . basename($rel);
+        if ($file['how'] === 'link' && @fileinode($live) === fileinode($source . '/' . $rel)) continue;
+        $staged = $staging . '/wishes/' . basename($rel);
+        $file['how'] === 'link' ? link($source . '/' . $rel, $staged) : copy($source . '/' . $rel, $staged);
+        $journal['moves'][] = ['from' => $staged, 'to' => $live];
+    }
+    $wishManifest = segLoadManifest($sourceWishes);
+    $wishHead = segLoadHead($sourceWishes);
+    foreach (['manifest.json' => $wishManifest, 'head.json' => $wishHead] as $name => $data) {
+        segWriteJson($staging . '/wishes/' . $name, $data);
+        $journal['moves'][] = ['from' => $staging . '/wishes/' . $name, 'to' => $wishDir . '/' . $name];
+    }
+
+    // Account/IP lists for the restored ids, built from the snapshot's own segments
+    foreach (segList($sourceWishes) as $segment) {
+        segScan($sourceWishes, $segment['segment'], $segment['bytes'], function($record, $offset) use ($staging, $segment) {
+            wishIndexRecord($staging . '/wishes', $record, ['id' => $record['id'], 'segment' => $segment['segment'], 'offset' => $offset]);
+        });
+    }
+    foreach (['user', 'ip'] as $kind) {
+        if (!is_dir($staging . '/wishes/by_' . $kind)) {
+            mkdir($staging . '/wishes/by_' . $kind, 0750);
+        }
+        $journal['moves'][] = ['from' => $staging . '/wishes/by_' . $kind, 'to' => $wishDir . '/by_' . $kind, 'replace_dir' => true];
+    }
+
+    $targets = ['log.txt' => $root . '/log.txt', 'payout_queue.txt' => $root . '/payout_queue.txt',
+        'private/credits.json' => $privateDir . '/credits.json', 'private/index/log_base.dat' => $privateDir . '/index/log_base.dat'];
+    foreach ($targets as $rel => $live) {
+        if (!isset($manifest['files'][$rel])) continue;
+        $staged = $staging . '/' . str_replace('/', '_', $rel);
+        copy($source . '/' . $rel, $staged);
+        $journal['moves'][] = ['from' => $staged, 'to' => $live, 'keep_bak' => $rel === 'private/credits.json'];
+    }
+
+    // Sketches come back whole; snapshots taken before they were included leave the live ones alone
+    $sketches = array_filter(array_keys($manifest['files']), function($rel) {
+        return strpos($rel, 'private/hll/') === 0;
+    });
+    if ($sketches) {
+        foreach ($sketches as $rel) {
+            $staged = $staging . '/hll/' . substr($rel, strlen('private/hll/'));
+            if (!is_dir(dirname($staged))) {
+                mkdir(dirname($staged), 0750, true);
+            }
+            copy($source . '/' . $rel, $staged);
+        }
+        $journal['moves'][] = ['from' => $staging . '/hll', 'to' => $privateDir . '/hll', 'replace_dir' => true];
+    }
+
+    $locks = backupLockAll($root, $privateDir, $creditsFile, LOCK_EX);
+
+    // Live segments the snapshot does not have, and the index of its formerly active segment
+    $keep = array_column($wishManifest['segments'], 'segment');
+    foreach (glob($wishDir . '/seg-*.*') ?: [] as $path) {
+        if (preg_match('/seg-(\d+)\.(log|inv)$/', $path, $m) && !in_array((int)$m[1], $keep, true)
+            && !((int)$m[1] === $wishHead['segment'] && $m[2] === 'log')) {
+            $journal['remove'][] = $path;
+        }
+    }
+    // Derived stores and checkpoints describe the replaced contents; bin/rebuild.php recreates them
+    foreach (['index/log_state.json', 'index/recovery.json', 'index/drift.json', 'index/accounts.bloom', 'cube'] as $rel) {
+        $journal['remove'][] = $privateDir . '/' . $rel;
+    }
+    if (!isset($manifest['files']['private/index/log_base.dat'])) {
+        $journal['remove'][] = $privateDir . '/index/log_base.dat';
+    }
+
+    segWriteJson($staging . '/JOURNAL.json', $journal);
+    backupRestoreApply($privateDir, $journal);
+
+    backupUnlockAll($locks);
+    flock($maintenance, LOCK_UN);
+    fclose($maintenance);
+    return ['success' => true, 'generation' => $generation, 'created' => $manifest['created']];
+}
+
+/**
+ * Carry out a committed restore journal; safe to repeat after a crash
+ */
+function backupRestoreApply($privateDir, $journal) {
+    foreach ($journal['remove'] as $path) {
+        is_dir($path) ? backupRemoveTree($path) : @unlink($path);
+    }
+    foreach ($journal['moves'] as $move) {
+        if (!file_exists($move['from'])) continue; // moved before the crash
+        if (!empty($move['replace_dir'])) {
+            backupRemoveTree($move['to']);
+        }
+        if (!empty($move['keep_bak']) && file_exists($move['to'])) {
+            @unlink($move['to'] . '.bak');
+            @link($move['to'], $move['to'] . '.bak');
+        }
+        if (!is_dir(dirname($move['to']))) {
+            mkdir(dirname($move['to']), 0750, true);
+        }
+        rename($move['from'], $move['to']);
+    }
+    backupRemoveTree($privateDir . '/restore');
+}
+
+/**
+ * Finish a restore that committed its journal but did not complete, or drop
+ * the staging of one that never committed; returns the generation finished or null
+ */
+function backupRestoreResume($root, $privateDir, $creditsFile) {
+    if (!is_dir($privateDir . '/restore')) return null;
+    $journal = @json_decode(@file_get_contents($privateDir . '/restore/JOURNAL.json'), true);
+    if (!is_array($journal)) {
+        backupRemoveTree($privateDir . '/restore');
+        return null;
+    }
+    $locks = backupLockAll($root, $privateDir, $creditsFile, LOCK_EX);
+    backupRestoreApply($privateDir, $journal);
+    backupUnlockAll($locks);
+    return $journal['generation'];
+}
+
+/**
+ * Delete all but the newest $keep generations
+ */
+function backupPrune($snapshotDir, $keep) {
+    $removed = 0;
+    foreach (array_slice(array_reverse(backupGenerations($snapshotDir)), $keep) as $generation) {
+        backupRemoveTree(backupPath($snapshotDir, $generation));
+        $removed++;
+    }
+    return $removed;
+}
+
+function backupRemoveTree($dir) {
+    foreach (glob($dir . '/{,.}[!.]*', GLOB_BRACE) ?: [] as $path) {
+        is_dir($path) ? backupRemoveTree($path) : unlink($path);
+    }
+    @rmdir($dir);
+}
@@ -0,0 +1,150 @@
+<?php
+/**
+ * Persistent Bloom filter of accounts that have ever played or held credits
+ * Blocked layout: every account maps to one 64-byte block and sets BLOOM_HASHES
+ * bits inside it, so a probe is a single small read. The file starts with a
+ * 64-byte header; the ready flag is only set by bin/rebuild.php once the
+ * history has been folded in, and until then lookups never report a miss.
+ */
+
+define('BLOOM_BLOCK', 64);
+define('BLOOM_BLOCKS', 16384);   // 1 MB of bits, ~1% false positives at 1M accounts
+define('BLOOM_HASHES', 7);
+define('BLOOM_MAGIC', 'ZBLOOM1');
+
+/**
+ * Block number and bit positions (0-511) within the block for an account
+ */
+function bloomHash($account) {
+    $h = unpack('N4', md5($account, true));
+    $block = $h[1] % BLOOM_BLOCKS;
+    $a = $h[2] & 511;
+    $b = ($h[3] & 511) | 1;
+    $bits = [];
+    for ($i = 0; $i < BLOOM_HASHES; $i++) {
+        $bits[] = ($a + $i * $b) & 511;
+    }
+    return [$block, $bits];
+}
+
+function bloomSetBits($block, $bits) {
+    foreach ($bits as $bit) {
+        $byte = $bit >> 3;
+        $block[$byte] = chr(ord($block[$byte]) | (1 << ($bit & 7)));
+    }
+    return $block;
+}
+
+function bloomHasBits($block, $bits) {
+    foreach ($bits as $bit) {
+        if (!(ord($block[$bit >> 3]) & (1 << ($bit & 7)))) return false;
+    }
+    return true;
+}
+
+function bloomEmpty() {
+    return str_repeat("\0", BLOOM_BLOCK * BLOOM_BLOCKS);
+}
+
+function bloomReadBlock($fp, $block) {
+    fseek($fp, BLOOM_BLOCK + $block * BLOOM_BLOCK);
+    $data = fread($fp, BLOOM_BLOCK);
+    return str_pad($data === false ? '' : $data, BLOOM_BLOCK, "\0");
+}
+
+/**
+ * Record an account (call before the write it guards)
+ */
+function bloomAdd($file, $account) {
+    list($block, $bits) = bloomHash($account);
+    $fp = @fopen($file, 'c+');
+    if (!$fp) {
+        if (!is_dir(dirname($file))) {
+            @mkdir(dirname($file), 0750, true);
+        }
+        $fp = @fopen($file, 'c+');
+        if (!$fp) return false;
+    }
+
+    if (bloomHasBits(bloomReadBlock($fp, $block), $bits)) {
+        fclose($fp);
+        return true;
+    }
+
+    // Bounded wait: this runs on the request path ahead of the log append
+    if (!storeLock($fp, LOCK_EX)) {
+        fclose($fp);
+        return false;
+    }
+    $current = bloomReadBlock($fp, $block);
+    fseek($fp, BLOOM_BLOCK + $block * BLOOM_BLOCK);
+    fwrite($fp, bloomSetBits($current, $bits));
+    fflush($fp);
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return true;
+}
+
+/**
+ * True only when the filter is ready and proves the account was never recorded
+ */
+function bloomDefinitelyAbsent($file, $account) {
+    $map = mmapOpen($file);
+    if (!$map || mmapRead($map, 0, strlen(BLOOM_MAGIC) + 1) !== BLOOM_MAGIC . "\1") {
+        return false;
+    }
+
+    list($block, $bits) = bloomHash($account);
+    $base = BLOOM_BLOCK + $block * BLOOM_BLOCK;
+    foreach ($bits as $bit) {
+        if (!((mmapByte($map, $base + ($bit >> 3)) ?? 0) & (1 << ($bit & 7)))) return true;
+    }
+    return false;
+}
+
+/**
+ * Rebuild derivation: filter bits for every account in the log
+ */
+function bloomLogAdd(&$filter, $rec, $offset) {
+    if (!is_string($filter)) {
+        $filter = bloomEmpty();
+    }
+    list($block, $bits) = bloomHash($rec['user']);
+    // Set bytes in place; copying the 1 MB string per record would dominate the scan
+    foreach ($bits as $bit) {
+        $pos = $block * BLOOM_BLOCK + ($bit >> 3);
+        $filter[$pos] = chr(ord($filter[$pos]) | (1 << ($bit & 7)));
+    }
+}
+
+function bloomLogMerge(&$filter, $part) {
+    if (!is_string($part)) return;
+    $filter = is_string($filter) ? ($filter | $part) : $part;
+}
+
+/**
+ * OR the rebuilt bits and all credits.json accounts into the stored filter,
+ * then mark it ready
+ */
+function bloomPublish($filter, $privateDir) {
+    $filter = is_string($filter) ? $filter : bloomEmpty();
+
+    $credits = json_decode(@file_get_contents($privateDir . '/credits.json'), true);
+    foreach (is_array($credits) ? array_keys($credits) : [] as $account) {
+        bloomLogAdd($filter, ['user' => (string)$account], 0);
+    }
+
+    $file = $privateDir . '/index/accounts.bloom';
+    if (!is_dir(dirname($file))) {
+        mkdir(dirname($file), 0750, true);
+    }
+    $fp = fopen($file, 'c+');
+    flock($fp, LOCK_EX);
+    fseek($fp, BLOOM_BLOCK);
+    $current = str_pad((string)stream_get_contents($fp), BLOOM_BLOCK * BLOOM_BLOCKS, "\0");
+    rewind($fp);
+    fwrite($fp, str_pad(BLOOM_MAGIC . "\1", BLOOM_BLOCK, "\0") . ($current | $filter));
+    fflush($fp);
+    flock($fp, LOCK_UN);
+    fclose($fp);
+}
@@ -0,0 +1,21 @@
+<?php
+/**
+ * Shared bootstrap for the request entry points (psychic_queue.php, credits.php)
+ * Loads every library (preload.php compiles the same files into opcache) and
+ * resolves the node configuration. It makes no filesystem checks:
+ * bin/install.php creates directories and files ahead of time, and request
+ * code opens only the files its action needs, creating dynamic
+ * subdirectories on first write.
+ */
+
+foreach (['storage.php', 'framing.php', 'logindex.php', 'cube.php', 'hll.php', 'bloom.php',
+          'segstore.php', 'wishindex.php', 'wishquery.php', 'admin.php', 'replication.php',
+          'games.php', 'accountdict.php', 'freewish.php', 'contentfilter.php', 'export.php',
+          'gameconfig.php', 'mmap.php', 'drift.php', 'velocity.php', 'profiler.php',
+          'wire.php'] as $library) {
+    require_once __DIR__ . '/' . $library;
+}
+
+// Node role: 'primary' (default) or 'replica' (read-only copy fed by bin/replica.php)
+$ROLE = getenv('ZOLTARAN_ROLE') ?: 'primary';
+$DATA_DIR = getenv('ZOLTARAN_DATA_DIR') ?: dirname(__DIR__);
@@ -0,0 +1,208 @@
+<?php
+/**
+ * Wish content filter: one linear pass per wish
+ * Blocked patterns are compiled into an Aho-Corasick automaton, flattened to a
+ * full transition table so every input character costs one array lookup and
+ * there is no backtracking. The same pass
+ *   - decodes UTF-8 and folds fullwidth forms (U+FF01..U+FF5E) to ASCII,
+ *   - drops zero-width and BOM characters,
+ *   - lowercases and collapses whitespace runs to one space for matching,
+ *   - emits the sanitized wish (the allowed character set, capped in length),
+ *   - tracks the "on<word>\s*=" event-handler rule with a small state machine.
+ * Patterns come from private/filter.json when present, e.g.
+ *   {"patterns": ["<script", "javascript:", "drop table"], "event_handlers": true}
+ * A space in a pattern matches any run of whitespace.
+ * The compiled automaton is written next to the config as
+ * index/filter-<hash of config>.php and included from then on, so opcache
+ * keeps it in shared memory and requests skip the build; editing the config
+ * changes the hash and compiles a new one, removing the old ones.
+ */
+
+define('FILTER_WISH_MAX', 180);
+
+function contentFilterDefaults() {
+    return [
+        'patterns' => [
+            '<script', 'javascript:', 'select ', 'insert ', 'delete ', 'drop ', 'update ', 'union ',
+            'eval(', 'exec(', 'system(', '${', '<?', '<%', '\\x'
+        ],
+        'event_handlers' => true
+    ];
+}
+
+/**
+ * Configured filter, from the opcache-cached compiled file when there is one
+ */
+function contentFilterLoad($configFile) {
+    static $compiled = [];
+    if (isset($compiled[$configFile])) {
+        return $compiled[$configFile];
+    }
+    $raw = @file_get_contents($configFile);
+    $cache = sprintf('%s/index/filter-%s.php', dirname($configFile), md5(__FILE__ . filemtime(__FILE__) . $raw));
+    $filter = @include $cache;
+    if (!is_array($filter)) {
+        $config = @json_decode($raw, true);
+        $config = is_array($config) ? $config + contentFilterDefaults() : contentFilterDefaults();
+        $filter = contentFilterCompile($config['patterns'], !empty($config['event_handlers']));
+        $tmp = $cache . '.' . getmypid() . '.tmp';
+        if (@file_put_contents($tmp, '<?php return ' . var_export($filter, true) . ";\n") !== false) {
+            if (@rename($tmp, $cache)) {
+                contentFilterPrune($cache);
+            }
+        }
+    }
+    return $compiled[$configFile] = $filter;
+}
+
+/**
+ * Drop compiled filters for older configs so they stop taking opcache memory
+ */
+function contentFilterPrune($cache) {
+    foreach (glob(dirname($cache) . '/filter-*.php') ?: [] as $old) {
+        if ($old === $cache) continue;
+        if (function_exists('opcache_invalidate')) {
+            @opcache_invalidate($old, true);
+        }
+        @unlink($old);
+    }
+}
+
+/**
+ * Build the automaton: $delta[state][byte] => state, $match[state] => true
+ */
+function contentFilterCompile($patterns, $eventHandlers = true) {
+    $goto = [[]];
+    $match = [];
+    foreach ($patterns as $pattern) {
+        $pattern = preg_replace('/\s+/', ' ', strtolower($pattern));
+        if ($pattern === '') continue;
+        $state = 0;
+        for ($i = 0, $n = strlen($pattern); $i < $n; $i++) {
+            $c = ord($pattern[$i]);
+            if (!isset($goto[$state][$c])) {
+                $goto[] = [];
+                $goto[$state][$c] = count($goto) - 1;
+            }
+            $state = $goto[$state][$c];
+        }
+        $match[$state] = true;
+    }
+
+    // Breadth-first failure links, folded into a complete transition table
+    $alphabet = [];
+    foreach ($goto as $edges) {
+        $alphabet += $edges;
+    }
+    $alphabet = array_keys($alphabet);
+    $fail = [0 => 0];
+    $delta = [0 => []];
+    foreach ($alphabet as $c) {
+        $delta[0][$c] = $goto[0][$c] ?? 0;
+    }
+    $queue = array_values($goto[0]);
+    foreach ($queue as $state) {
+        $fail[$state] = 0;
+    }
+    for ($q = 0; $q < count($queue); $q++) {
+        $state = $queue[$q];
+        if (isset($match[$fail[$state]])) {
+            $match[$state] = true;
+        }
+        foreach ($alphabet as $c) {
+            if (isset($goto[$state][$c])) {
+                $next = $goto[$state][$c];
+                $fail[$next] = $delta[$fail[$state]][$c];
+                $delta[$state][$c] = $next;
+                $queue[] = $next;
+            } else {
+                $delta[$state][$c] = $delta[$fail[$state]][$c];
+            }
+        }
+    }
+
+    return ['delta' => $delta, 'match' => $match, 'event_handlers' => $eventHandlers];
+}
+
+/**
+ * Scan and sanitize a wish in one pass
+ * Returns ['blocked' => bool, 'wish' => sanitized text]
+ */
+function contentFilter($filter, $text) {
+    $delta = $filter['delta'];
+    $match = $filter['match'];
+    $eventHandlers = $filter['event_handlers'];
+    $state = 0;
+    $handler = 0; // 0 idle, 1 after "o", 2 after "on", 3 "on" + word chars, 4 then whitespace
+    $lastSpace = false;
+    $out = '';
+    $outLength = 0;
+
+    for ($i = 0, $n = strlen($text); $i < $n; $i++) {
+        // Decode one UTF-8 character
+        $b = ord($text[$i]);
+        if ($b < 0x80) {
+            $cp = $b;
+        } elseif ($b >= 0xC2 && $b < 0xE0 && $i + 1 < $n) {
+            $cp = (($b & 0x1F) << 6) | (ord($text[++$i]) & 0x3F);
+        } elseif ($b >= 0xE0 && $b < 0xF0 && $i + 2 < $n) {
+            $cp = (($b & 0x0F) << 12) | ((ord($text[$i + 1]) & 0x3F) << 6) | (ord($text[$i + 2]) & 0x3F);
+            $i += 2;
+        } elseif ($b >= 0xF0 && $b < 0xF5 && $i + 3 < $n) {
+            $cp = 0x10000;
+            $i += 3;
+        } else {
+            $cp = 0xFFFD;
+        }
+
+        if (($cp >= 0x200B && $cp <= 0x200F) || $cp === 0x2060 || $cp === 0xFEFF) {
+            continue; // invisible: neither matched nor emitted
+        }
+        if ($cp >= 0xFF01 && $cp <= 0xFF5E) {
+            $cp -= 0xFEE0; // fullwidth ASCII
+        }
+
+        // Matching stream: lowercase ASCII, whitespace runs as one space
+        $space = $cp === 0x20 || ($cp >= 0x09 && $cp <= 0x0D) || $cp === 0xA0 || $cp === 0x3000;
+        if ($cp < 0x80 || $space) {
+            $c = $space ? 0x20 : ($cp >= 0x41 && $cp <= 0x5A ? $cp | 0x20 : $cp);
+            if (!($space && $lastSpace)) {
+                $state = $delta[$state][$c] ?? 0;
+                if (isset($match[$state])) {
+                    return ['blocked' => true, 'wish' => ''];
+                }
+            }
+            $lastSpace = $space;
+
+            if ($eventHandlers) {
+                $word = ($c >= 0x61 && $c <= 0x7A) || ($c >= 0x30 && $c <= 0x39) || $c === 0x5F;
+                if ($handler >= 3 && $c === 0x3D) {
+                    return ['blocked' => true, 'wish' => ''];
+                } elseif ($handler === 3 && $word) {
+                    // still inside the handler name
+                } elseif ($handler >= 3 && $space) {
+                    $handler = 4;
+                } elseif ($handler === 2 && $word) {
+                    $handler = 3;
+                } elseif ($handler === 1 && $c === 0x6E) {
+                    $handler = 2;
+                } else {
+                    $handler = $c === 0x6F ? 1 : 0;
+                }
+            }
+        } else {
+            $state = 0;
+            $lastSpace = false;
+            $handler = 0;
+        }
+
+        // Output stream: the allowed character set, original case and line breaks
+        if ($outLength < FILTER_WISH_MAX && $cp < 0x80
+            && (ctype_alnum(chr($cp)) || strpos(" .,!?'\"\n\r-", chr($cp)) !== false)) {
+            $out .= chr($cp);
+            $outLength++;
+        }
+    }
+
+    return ['blocked' => false, 'wish' => $out];
+}
@@ -0,0 +1,251 @@
+<?php
+/**
+ * Hourly rollup cube over game results
+ * Cells are keyed by (hour, result, tokens bucket) and hold [count, tokens_sum].
+ * Layout under the cube directory:
+ *   YYYY-MM.json     {"total": {cell: [c, s]}, "days": {"DD": {cell: [c, s]}}}
+ *   YYYY-MM/DD.json  {"hours": {"HH": {cell: [c, s]}}}
+ * Queries merge whole months and days from the month file and only open day
+ * files for partial days or hourly grouping.
+ */
+
+define('CUBE_DIMENSIONS', ['hour', 'day', 'month', 'result', 'bucket']);
+
+/**
+ * Tokens bucket label for a payout amount
+ */
+function cubeTokensBucket($tokens) {
+    if ($tokens <= 0) return '0';
+    if ($tokens <= 250) return '1-250';
+    if ($tokens <= 500) return '251-500';
+    if ($tokens <= 1000) return '501-1000';
+    return '1001+';
+}
+
+function cubeCell($result, $tokens) {
+    return $result . '|' . cubeTokensBucket($tokens);
+}
+
+function cubeAddCell(&$cells, $cell, $count, $sum) {
+    if (!isset($cells[$cell])) {
+        $cells[$cell] = [0, 0];
+    }
+    $cells[$cell][0] += $count;
+    $cells[$cell][1] += $sum;
+}
+
+/**
+ * Read-modify-write a JSON file under an exclusive lock (bounded wait; false
+ * when the lock or the file could not be had)
+ */
+function cubeUpdateFile($path, $fn) {
+    $fp = @fopen($path, 'c+');
+    if (!$fp) {
+        @mkdir(dirname($path), 0750, true);
+        $fp = @fopen($path, 'c+');
+        if (!$fp) return false;
+    }
+
+    if (!storeLock($fp, LOCK_EX)) {
+        fclose($fp);
+        return false;
+    }
+    $data = json_decode(stream_get_contents($fp), true);
+    $data = $fn(is_array($data) ? $data : []);
+    ftruncate($fp, 0);
+    rewind($fp);
+    fwrite($fp, json_encode($data));
+    fflush($fp);
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return true;
+}
+
+/**
+ * Fold one appended result into the cube (called after the log append)
+ * $logAt is where storeAppend() put the line. Files published by a rebuild
+ * carry the log position they already count ("log": [inode, offset]), and a
+ * line before that position is not added again.
+ */
+function cubeRecord($dir, $timestamp, $result, $tokens, $logAt = null) {
+    $hourKey = logHourKey($timestamp);
+    $month = substr($hourKey, 0, 7);
+    $day = substr($hourKey, 8, 2);
+    $hour = substr($hourKey, 11, 2);
+    $cell = cubeCell($result, $tokens);
+    $counted = function($data) use ($logAt) {
+        return $logAt !== null && isset($data['log'])
+            && $data['log'][0] === $logAt['inode'] && $logAt['offset'] < $data['log'][1];
+    };
+
+    cubeUpdateFile("$dir/$month/$day.json", function($data) use ($hour, $cell, $tokens, $counted) {
+        if ($counted($data)) return $data;
+        cubeAddCell($data['hours'][$hour], $cell, 1, $tokens);
+        return $data;
+    });
+    cubeUpdateFile("$dir/$month.json", function($data) use ($day, $cell, $tokens, $counted) {
+        if ($counted($data)) return $data;
+        cubeAddCell($data['total'], $cell, 1, $tokens);
+        cubeAddCell($data['days'][$day], $cell, 1, $tokens);
+        return $data;
+    });
+}
+
+/**
+ * Rebuild derivation: hour key => cells
+ */
+function cubeLogAdd(&$hours, $rec, $offset) {
+    cubeAddCell($hours[logHourKey($rec['timestamp'])], cubeCell($rec['result'], $rec['tokens']), 1, $rec['tokens']);
+}
+
+function cubeLogMerge(&$hours, $part) {
+    foreach ($part as $hourKey => $cells) {
+        foreach ($cells as $cell => $v) {
+            cubeAddCell($hours[$hourKey], $cell, $v[0], $v[1]);
+        }
+    }
+}
+
+/**
+ * Publish a rebuilt hour map that counts the log up to $logEnd
+ */
+function cubePublish($hours, $privateDir, $logFile = null, $logEnd = null) {
+    return cubeWriteAll($privateDir . '/cube', $hours, $logFile, $logEnd);
+}
+
+/**
+ * Add an hour map into month and day file contents keyed by path
+ */
+function cubeAddHours(&$files, $dir, $hours) {
+    foreach ($hours as $hourKey => $cells) {
+        $month = substr($hourKey, 0, 7);
+        $day = substr($hourKey, 8, 2);
+        $hour = substr($hourKey, 11, 2);
+        foreach ($cells as $cell => $v) {
+            cubeAddCell($files["$dir/$month.json"]['total'], $cell, $v[0], $v[1]);
+            cubeAddCell($files["$dir/$month.json"]['days'][$day], $cell, $v[0], $v[1]);
+            cubeAddCell($files["$dir/$month/$day.json"]['hours'][$hour], $cell, $v[0], $v[1]);
+        }
+    }
+}
+
+/**
+ * Rewrite the cube files for every period in a rebuilt hour map
+ * Files of other periods are left alone: they may cover archived log lines
+ * or have had their day files pruned by retention.
+ * Requests keep recording while this runs, so each file is rewritten in
+ * place under the lock cubeRecord() takes (a rename would strand increments
+ * made through handles opened before it). Inside that lock, lines appended
+ * to the log since $logEnd are folded in first and the file is marked with
+ * the position it now counts up to: increments for earlier lines are then
+ * skipped, and later ones land on top, so none is lost or counted twice.
+ * Returns false if any file could not be locked or written.
+ */
+function cubeWriteAll($dir, $hours, $logFile = null, $logEnd = null) {
+    $files = [];
+    cubeAddHours($files, $dir, $hours);
+    $inode = $logFile !== null ? @fileinode($logFile) : null;
+
+    $ok = true;
+    foreach (array_keys($files) as $path) {
+        $ok = cubeUpdateFile($path, function() use (&$files, &$logEnd, $path, $dir, $logFile, $inode) {
+            if ($logFile === null) return $files[$path];
+            $fp = @fopen($logFile, 'rb');
+            if ($fp && flock($fp, LOCK_SH)) {
+                $eof = fstat($fp)['size'];
+                flock($fp, LOCK_UN);
+                if ($eof > $logEnd) {
+                    $tail = logScanRange($logFile, $logEnd, $eof, null, true);
+                    cubeAddHours($files, $dir, $tail['derived']['cube'] ?? []);
+                    $logEnd = $eof;
+                }
+            }
+            if ($fp) fclose($fp);
+            return $files[$path] + ['log' => [$inode, $logEnd]];
+        }) && $ok;
+    }
+    return $ok;
+}
+
+/**
+ * Normalize a query bound ("YYYY-MM", "YYYY-MM-DD" or "YYYY-MM-DDTHH") to an hour key
+ */
+function cubeHourBound($value, $isEnd) {
+    if (preg_match('/^\d{4}-\d{2}$/', $value)) {
+        $value .= $isEnd ? '-' . date('t', strtotime("$value-01")) : '-01';
+    }
+    if (preg_match('/^\d{4}-\d{2}-\d{2}$/', $value)) {
+        $value .= $isEnd ? 'T23' : 'T00';
+    }
+    if (!preg_match('/^\d{4}-\d{2}-\d{2}T\d{2}$/', $value)) {
+        return null;
+    }
+    return $value;
+}
+
+/**
+ * Merge cube cells over [$from, $to] (inclusive hour keys), grouped by $groupBy dimensions
+ */
+function cubeQuery($dir, $from, $to, $groupBy) {
+    $needHours = in_array('hour', $groupBy, true);
+    $needDays = $needHours || in_array('day', $groupBy, true);
+    $groups = [];
+
+    $emit = function($hourKey, $cells) use (&$groups, $groupBy) {
+        foreach ($cells as $cell => $v) {
+            list($result, $bucket) = explode('|', $cell, 2);
+            $dims = [
+                'hour' => $hourKey,
+                'day' => substr($hourKey, 0, 10),
+                'month' => substr($hourKey, 0, 7),
+                'result' => $result,
+                'bucket' => $bucket
+            ];
+            $row = [];
+            foreach ($groupBy as $dim) {
+                $row[$dim] = $dims[$dim];
+            }
+            $key = implode("\x1f", $row);
+            if (!isset($groups[$key])) {
+                $groups[$key] = $row + ['count' => 0, 'tokens' => 0];
+            }
+            $groups[$key]['count'] += $v[0];
+            $groups[$key]['tokens'] += $v[1];
+        }
+    };
+
+    $month = substr($from, 0, 7);
+    $lastMonth = substr($to, 0, 7);
+    while ($month <= $lastMonth) {
+        $monthData = @json_decode(@file_get_contents("$dir/$month.json"), true);
+        if (is_array($monthData)) {
+            $monthStart = "$month-01T00";
+            $monthEnd = "$month-" . date('t', strtotime("$month-01")) . 'T23';
+
+            if (!$needDays && $from <= $monthStart && $to >= $monthEnd) {
+                $emit($monthStart, $monthData['total'] ?? []);
+            } else {
+                foreach ($monthData['days'] ?? [] as $day => $cells) {
+                    $dayStart = "$month-{$day}T00";
+                    $dayEnd = "$month-{$day}T23";
+                    if ($dayEnd < $from || $dayStart > $to) continue;
+
+                    if (!$needHours && $from <= $dayStart && $to >= $dayEnd) {
+                        $emit($dayStart, $cells);
+                        continue;
+                    }
+                    $dayData = @json_decode(@file_get_contents("$dir/$month/$day.json"), true);
+                    foreach ($dayData['hours'] ?? [] as $hour => $hourCells) {
+                        $hourKey = "$month-{$day}T$hour";
+                        if ($hourKey < $from || $hourKey > $to) continue;
+                        $emit($hourKey, $hourCells);
+                    }
+                }
+            }
+        }
+        $month = date('Y-m', strtotime("$month-01 +1 month"));
+    }
+
+    ksort($groups);
+    return array_values($groups);
+}
@@ -0,0 +1,147 @@
+<?php
+/**
+ * Outcome distribution monitor
+ * Every logged result is checked against the outcome probabilities of the
+ * game config manifest (lib/gameconfig.php) with two sequential tests:
+ *   - chi-square goodness of fit over a sliding window of the last
+ *     DRIFT_BLOCKS x DRIFT_BLOCK results, re-evaluated whenever a block fills;
+ *   - an SPRT on the rare DRIFT_SPRT_OUTCOME, testing its configured rate p0
+ *     against DRIFT_SPRT_RATIO x p0, so a jackpot running hot shows up long
+ *     before a window test has the counts for it.
+ * State lives in private/index/drift.json (per game):
+ *   {"version", "totals": {code: n}, "block": {code: n}, "block_n",
+ *    "blocks": [{code: n}, ...], "window": {code: n}, "window_n",
+ *    "chi2": {...}, "sprt": {"llr", "n"}, "alarms": {name: {...}}}
+ * An update touches a fixed number of counters, so the cost per result is
+ * constant. A new manifest version restarts the window and the SPRT.
+ */
+
+define('DRIFT_BLOCK', 100);
+define('DRIFT_BLOCKS', 10);
+// Chi-square critical values at alpha = 0.001 by degrees of freedom
+define('DRIFT_CHI2_CRITICAL', [1 => 10.828, 13.816, 16.266, 18.467, 20.515, 22.458, 24.322, 26.124, 27.877, 29.588]);
+define('DRIFT_SPRT_OUTCOME', 'TOKENS_1000');
+define('DRIFT_SPRT_RATIO', 2.0);
+define('DRIFT_SPRT_ALPHA', 0.01);
+define('DRIFT_SPRT_BETA', 0.01);
+
+/**
+ * Result code => configured probability
+ */
+function driftExpected($config) {
+    $expected = [];
+    foreach ($config['outcomes'] ?? [] as $code => $outcome) {
+        if (($outcome['probability'] ?? 0) > 0) {
+            $expected[$code] = (float)$outcome['probability'];
+        }
+    }
+    return $expected;
+}
+
+function driftChiSquare($counts, $n, $expected) {
+    $statistic = 0.0;
+    foreach ($expected as $code => $p) {
+        $e = $n * $p;
+        $o = $counts[$code] ?? 0;
+        $statistic += ($o - $e) * ($o - $e) / $e;
+    }
+    return $statistic;
+}
+
+function driftRaise(&$state, $name, $details) {
+    if (!isset($state['alarms'][$name])) {
+        error_log("drift: $name alarm: " . json_encode($details));
+        $details['since'] = date('c');
+    } else {
+        $details['since'] = $state['alarms'][$name]['since'];
+    }
+    $state['alarms'][$name] = $details;
+}
+
+/**
+ * Fold one result into the monitor (called after the log append)
+ */
+function driftRecord($file, $config, $resultCode) {
+    $expected = driftExpected($config);
+    if (!isset($expected[$resultCode])) return;
+    $version = $config['version'] ?? 0;
+
+    cubeUpdateFile($file, function($state) use ($expected, $version, $resultCode) {
+        if (($state['version'] ?? null) !== $version) {
+            $state = [
+                'version' => $version,
+                'totals' => $state['totals'] ?? [],
+                'block' => [], 'block_n' => 0,
+                'blocks' => [], 'window' => [], 'window_n' => 0,
+                'chi2' => null,
+                'sprt' => ['llr' => 0.0, 'n' => 0],
+                'alarms' => []
+            ];
+        }
+        $state['totals'][$resultCode] = ($state['totals'][$resultCode] ?? 0) + 1;
+        $state['block'][$resultCode] = ($state['block'][$resultCode] ?? 0) + 1;
+        $state['block_n']++;
+
+        // Sliding window: whole blocks enter and leave, so the window is updated once per block
+        if ($state['block_n'] >= DRIFT_BLOCK) {
+            $state['blocks'][] = $state['block'];
+            foreach ($state['block'] as $code => $n) {
+                $state['window'][$code] = ($state['window'][$code] ?? 0) + $n;
+            }
+            $state['window_n'] += $state['block_n'];
+            if (count($state['blocks']) > DRIFT_BLOCKS) {
+                foreach (array_shift($state['blocks']) as $code => $n) {
+                    $state['window'][$code] -= $n;
+                    $state['window_n'] -= $n;
+                }
+            }
+            $state['block'] = [];
+            $state['block_n'] = 0;
+
+            if (count($state['blocks']) === DRIFT_BLOCKS) {
+                $df = count($expected) - 1;
+                $critical = DRIFT_CHI2_CRITICAL[min($df, 10)] ?? null;
+                $statistic = driftChiSquare($state['window'], $state['window_n'], $expected);
+                $state['chi2'] = ['statistic' => round($statistic, 3), 'df' => $df, 'critical' => $critical, 'n' => $state['window_n']];
+                if ($critical !== null && $statistic > $critical) {
+                    driftRaise($state, 'chi_square', $state['chi2'] + ['window' => $state['window']]);
+                } else {
+                    unset($state['alarms']['chi_square']);
+                }
+            }
+        }
+
+        // SPRT on the rare outcome; a decision either way restarts the test
+        if (isset($expected[DRIFT_SPRT_OUTCOME])) {
+            $p0 = $expected[DRIFT_SPRT_OUTCOME];
+            $p1 = min(0.999, $p0 * DRIFT_SPRT_RATIO);
+            $state['sprt']['llr'] += $resultCode === DRIFT_SPRT_OUTCOME ? log($p1 / $p0) : log((1 - $p1) / (1 - $p0));
+            $state['sprt']['n']++;
+            if ($state['sprt']['llr'] >= log((1 - DRIFT_SPRT_BETA) / DRIFT_SPRT_ALPHA)) {
+                driftRaise($state, 'sprt_' . DRIFT_SPRT_OUTCOME, ['p0' => $p0, 'p1' => $p1, 'n' => $state['sprt']['n']]);
+                $state['sprt'] = ['llr' => 0.0, 'n' => 0];
+            } elseif ($state['sprt']['llr'] <= log(DRIFT_SPRT_BETA / (1 - DRIFT_SPRT_ALPHA))) {
+                unset($state['alarms']['sprt_' . DRIFT_SPRT_OUTCOME]);
+                $state['sprt'] = ['llr' => 0.0, 'n' => 0];
+            }
+        }
+        return $state;
+    });
+}
+
+/**
+ * Monitor state for the metrics endpoint
+ */
+function driftMetrics($file, $config) {
+    $state = @json_decode(@file_get_contents($file), true);
+    $state = is_array($state) ? $state : [];
+    return [
+        'config_version' => $config['version'] ?? 0,
+        'expected' => driftExpected($config),
+        'totals' => $state['totals'] ?? [],
+        'window' => ['n' => $state['window_n'] ?? 0, 'counts' => $state['window'] ?? [], 'size' => DRIFT_BLOCKS * DRIFT_BLOCK],
+        'chi2' => $state['chi2'] ?? null,
+        'sprt' => ($state['sprt'] ?? ['llr' => 0.0, 'n' => 0]) + ['outcome' => DRIFT_SPRT_OUTCOME],
+        'alarms' => (object)($state['alarms'] ?? [])
+    ];
+}
@@ -0,0 +1,221 @@
+<?php
+/**
+ * Result exports for offline analytics
+ * NDJSON streams one JSON object per line from the public log or the private
+ * wish store. Columnar files hold one wish segment each:
+ *   "ZCOL1\n"                magic
+ *   uint32 BE                header length
+ *   header JSON              {"segment", "rows", "columns": [{"name", "type"}], "dict": {column: [values]}}
+ *   columns, in header order:
+ *     u32 / i32              rows x 4 bytes, big-endian
+ *     dict                   rows x u16 index into header "dict"
+ *     str                    (rows + 1) x u32 offsets, then the bytes
+ * Both honour a from/to time range, compared as instants (wishTime()) like the
+ * seeks: the log is entered at the sparse hour index offset, and wish segments
+ * are skipped by their manifest time range and entered at the sampled offset. Memory stays flat: the log streams line by
+ * line and a columnar file buffers a single segment.
+ */
+
+define('EXPORT_COLUMNS', [
+    ['name' => 'id', 'type' => 'u32'],
+    ['name' => 'time', 'type' => 'u32'],
+    ['name' => 'user', 'type' => 'dict'],
+    ['name' => 'result', 'type' => 'dict'],
+    ['name' => 'result_code', 'type' => 'dict'],
+    ['name' => 'tokens', 'type' => 'i32'],
+    ['name' => 'memo', 'type' => 'str'],
+    ['name' => 'wish', 'type' => 'str']
+]);
+
+// Sparse hour keys carry no UTC offset, and writers' offsets span up to 26 hours
+define('EXPORT_HOUR_SLACK', 93600);
+
+/**
+ * Exclusive end instant of $to, which is inclusive at its own precision
+ * ("2026-10" covers the whole month, "2026-10-18T07" the whole hour)
+ */
+function exportRangeEnd($to) {
+    $steps = [
+        '/^\d{4}$/' => ['-01-01', '+1 year'],
+        '/^\d{4}-\d{2}$/' => ['-01', '+1 month'],
+        '/^\d{4}-\d{2}-\d{2}$/' => ['', '+1 day'],
+        '/^\d{4}-\d{2}-\d{2}T\d{2}$/' => [':00', '+1 hour'],
+        '/^\d{4}-\d{2}-\d{2}T\d{2}:\d{2}$/' => ['', '+1 minute']
+    ];
+    foreach ($steps as $pattern => $step) {
+        if (preg_match($pattern, $to)) {
+            return (int)strtotime($to . $step[0] . ' ' . $step[1]);
+        }
+    }
+    return wishTime($to) + 1;
+}
+
+/**
+ * Whether $timestamp falls in [$fromTime, $toEnd) (instants; null is unbounded)
+ */
+function exportInRange($timestamp, $fromTime, $toEnd) {
+    $time = wishTime($timestamp);
+    return ($fromTime === null || $time >= $fromTime) && ($toEnd === null || $time < $toEnd);
+}
+
+/**
+ * Byte range of log.txt that can hold [$fromTime, $toEnd), from the sparse
+ * hour index; widened by EXPORT_HOUR_SLACK, the rows are filtered exactly
+ */
+function exportLogRange($logFile, $stateFile, $fromTime, $toEnd) {
+    $state = logCurrentState($logFile, $stateFile);
+    $start = 0;
+    $end = $state['log_offset'];
+    if ($fromTime !== null) {
+        $start = $end;
+        foreach ($state['derived']['sparse'] as $hour => $offset) {
+            if (wishTime($hour . ':00') + 3600 > $fromTime - EXPORT_HOUR_SLACK) {
+                $start = min($start, $offset);
+            }
+        }
+    }
+    if ($toEnd !== null) {
+        foreach ($state['derived']['sparse'] as $hour => $offset) {
+            if (wishTime($hour . ':00') >= $toEnd + EXPORT_HOUR_SLACK) {
+                $end = min($end, $offset);
+            }
+        }
+    }
+    return [$start, max($start, $end)];
+}
+
+/**
+ * Stream public log results as NDJSON to $out; returns the row count
+ */
+function exportLogNdjson($logFile, $stateFile, $from, $to, $out) {
+    $fromTime = $from === null ? null : wishTime($from);
+    $toEnd = $to === null ? null : exportRangeEnd($to);
+    list($start, $end) = exportLogRange($logFile, $stateFile, $fromTime, $toEnd);
+    $fp = @fopen($logFile, 'rb');
+    if (!$fp) return 0;
+    fseek($fp, $start);
+    $pos = $start;
+    $rows = 0;
+    while ($pos < $end && ($line = fgets($fp)) !== false) {
+        $pos += strlen($line);
+        $rec = parseLogLine($line);
+        if ($rec !== null && exportInRange($rec['timestamp'], $fromTime, $toEnd)) {
+            fwrite($out, json_encode($rec) . "\n");
+            $rows++;
+        }
+    }
+    fclose($fp);
+    return $rows;
+}
+
+/**
+ * Call $fn($segment, $record) for wish records in [$from, $to], oldest first
+ */
+function exportEachWish($wishDir, $from, $to, $fn) {
+    $segments = segList($wishDir);
+    $fromTime = $from === null ? null : wishTime($from);
+    $toEnd = $to === null ? null : exportRangeEnd($to);
+    $i = $from === null ? 0 : wishFirstSegmentFrom($segments, $from);
+    for (; $i < count($segments); $i++) {
+        $segment = $segments[$i];
+        if ($toEnd !== null && !exportInRange($segment['first_ts'] ?? null, null, $toEnd)) break;
+        $start = $from === null ? 0 : wishSeekTime($wishDir, $segment, $from);
+        $done = false;
+        segScan($wishDir, $segment['segment'], $segment['bytes'], function($record) use ($fn, $segment, $fromTime, $toEnd, &$done) {
+            $ts = $record['timestamp'] ?? null;
+            if (!exportInRange($ts, $fromTime, null)) return true;
+            if (!exportInRange($ts, null, $toEnd)) {
+                $done = true;
+                return false;
+            }
+            $fn($segment, $record);
+            return true;
+        }, $start);
+        if ($done) break;
+    }
+}
+
+/**
+ * Stream private wish records as NDJSON to $out; returns the row count
+ */
+function exportWishesNdjson($wishDir, $from, $to, $out) {
+    $rows = 0;
+    exportEachWish($wishDir, $from, $to, function($segment, $record) use ($out, &$rows) {
+        fwrite($out, json_encode($record) . "\n");
+        $rows++;
+    });
+    return $rows;
+}
+
+/**
+ * Encode buffered rows of one segment as a columnar file
+ */
+function exportColumnarWrite($path, $segment, $rows) {
+    $dict = [];
+    $body = '';
+    foreach (EXPORT_COLUMNS as $column) {
+        $name = $column['name'];
+        $values = array_column($rows, $name);
+        switch ($column['type']) {
+            case 'u32':
+            case 'i32':
+                $body .= pack('N*', ...array_map('intval', $values));
+                break;
+            case 'dict':
+                $dict[$name] = array_values(array_unique(array_map('strval', $values)));
+                $index = array_flip($dict[$name]);
+                $body .= pack('n*', ...array_map(function($v) use ($index) { return $index[(string)$v]; }, $values));
+                break;
+            case 'str':
+                $offsets = [0];
+                $bytes = '';
+                foreach ($values as $value) {
+                    $bytes .= (string)$value;
+                    $offsets[] = strlen($bytes);
+                }
+                $body .= pack('N*', ...$offsets) . $bytes;
+                break;
+        }
+    }
+    $header = json_encode(['segment' => $segment, 'rows' => count($rows), 'columns' => EXPORT_COLUMNS, 'dict' => $dict]);
+    return file_put_contents($path, "ZCOL1\n" . pack('N', strlen($header)) . $header . $body);
+}
+
+/**
+ * One columnar file per wish segment touching [$from, $to]; returns [files, rows]
+ */
+function exportColumnar($wishDir, $from, $to, $outDir) {
+    if (!is_dir($outDir)) {
+        mkdir($outDir, 0750, true);
+    }
+    $current = null;
+    $rows = [];
+    $files = 0;
+    $total = 0;
+    $flush = function() use (&$current, &$rows, &$files, &$total, $outDir) {
+        if ($current !== null && $rows) {
+            exportColumnarWrite(sprintf('%s/seg-%06d.col', $outDir, $current), $current, $rows);
+            $files++;
+            $total += count($rows);
+        }
+        $rows = [];
+    };
+    exportEachWish($wishDir, $from, $to, function($segment, $record) use (&$current, &$rows, $flush) {
+        if ($segment['segment'] !== $current) {
+            $flush();
+            $current = $segment['segment'];
+        }
+        $rows[] = [
+            'id' => $record['id'],
+            'time' => strtotime($record['timestamp'] ?? '') ?: 0,
+            'user' => $record['user'] ?? '',
+            'result' => $record['result'] ?? '',
+            'result_code' => $record['result_code'] ?? '',
+            'tokens' => $record['tokens'] ?? 0,
+            'memo' => $record['memo'] ?? '',
+            'wish' => $record['wish'] ?? ''
+        ];
+    });
+    $flush();
+    return [$files, $total];
+}
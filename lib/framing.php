@@ -0,0 +1,128 @@
+<?php
+/**
+ * Record framing for the append-only stores
+ * A framed line is "<payload><sep>~<length hex>:<crc32b>\n"; log.txt and
+ * payout_queue.txt use " | " as separator so the frame reads as one more
+ * column, wish segments use a tab. Lines written before framing have no
+ * frame and are accepted as they are.
+ */
+
+function frameRecord($payload, $sep = ' | ') {
+    return $payload . $sep . '~' . dechex(strlen($payload)) . ':' . hash('crc32b', $payload) . "\n";
+}
+
+/**
+ * Payload of a complete line, or null if the frame does not verify
+ */
+function unframeRecord($line, $sep = ' | ') {
+    $line = rtrim($line, "\r\n");
+    $pos = strrpos($line, $sep . '~');
+    if ($pos === false || !preg_match('/^~([0-9a-f]+):([0-9a-f]{8})$/', substr($line, $pos + strlen($sep)), $m)) {
+        return $line; // unframed (legacy) line
+    }
+    $payload = substr($line, 0, $pos);
+    if (strlen($payload) !== hexdec($m[1]) || hash('crc32b', $payload) !== $m[2]) {
+        return null;
+    }
+    return $payload;
+}
+
+/**
+ * Verify lines from $offset to EOF, truncating a torn final record
+ * Only an unterminated last line is a write that never finished. Complete
+ * lines that fail their checksum are reported by offset and left in place
+ * (readers skip them): they may be hand edits, such as a payout line marked
+ * PAID, and are for an operator to look at.
+ * $anchor is the frameAnchor() of the line ending at $offset from the last
+ * pass. Compaction replaces these files by rename (bin/recover.php also
+ * compares inodes), but the new file may still be longer than $offset, so a
+ * mismatch means the offset no longer falls on that line boundary and the
+ * whole file is verified.
+ * Returns ['start' => where verification began, 'offset' => verified end,
+ * 'anchor' => ..., 'corrupt' => n, 'corrupt_at' => [offsets], 'truncated' => bytes]
+ */
+function frameRecoverTail($file, $offset, $anchor = null, $sep = ' | ') {
+    $report = ['start' => $offset, 'offset' => $offset, 'anchor' => $anchor, 'corrupt' => 0, 'corrupt_at' => [], 'truncated' => 0];
+    $fp = @fopen($file, 'r+');
+    if (!$fp) return $report;
+
+    flock($fp, LOCK_EX);
+    $size = fstat($fp)['size'];
+    if ($offset > $size || ($offset > 0 && ($anchor === null || frameAnchor($fp, $offset) !== $anchor))) {
+        $offset = 0; // file was replaced or compacted; verify it all
+        $report['anchor'] = null;
+    }
+    $report['start'] = $offset;
+    fseek($fp, $offset);
+
+    $pos = $offset;
+    while (($line = fgets($fp)) !== false && substr($line, -1) === "\n") {
+        $report['anchor'] = md5($line);
+        if (unframeRecord($line, $sep) === null) {
+            $report['corrupt']++;
+            $report['corrupt_at'][] = $pos;
+        }
+        $pos += strlen($line);
+    }
+
+    if ($pos < $size) {
+        $report['truncated'] = $size - $pos;
+        ftruncate($fp, $pos);
+        fflush($fp);
+    }
+    flock($fp, LOCK_UN);
+    fclose($fp);
+
+    $report['offset'] = $pos;
+    return $report;
+}
+
+/**
+ * Hash of the complete line that ends at $offset, or null if $offset is not
+ * just past a newline (or the line is longer than 64 KB)
+ */
+function frameAnchor($fp, $offset) {
+    $start = max(0, $offset - 65536);
+    fseek($fp, $start);
+    $chunk = (string)fread($fp, $offset - $start);
+    if (substr($chunk, -1) !== "\n") return null;
+    $begin = strrpos($chunk, "\n", -2);
+    if ($begin === false && $start > 0) return null;
+    return md5($begin === false ? $chunk : substr($chunk, $begin + 1));
+}
+
+/**
+ * Atomically replace a keyed snapshot file, keeping the previous
+ * generation as <file>.bak for recovery
+ */
+function snapshotWrite($file, $contents) {
+    $tmp = $file . '.' . getmypid() . '.tmp';
+    $fp = fopen($tmp, 'wb');
+    if (!$fp) return false;
+    $ok = storeWrite($fp, $contents) && storeSync($fp);
+    fclose($fp);
+    if (!$ok) {
+        @unlink($tmp);
+        return false;
+    }
+
+    if (file_exists($file)) {
+        @unlink($file . '.bak');
+        @link($file, $file . '.bak');
+    }
+    return rename($tmp, $file);
+}
+
+/**
+ * Decode a JSON snapshot, falling back to the previous generation
+ * Returns null when neither decodes (the caller must not overwrite it)
+ */
+function snapshotRead($file) {
+    storeRead();
+    foreach ([$file, $file . '.bak'] as $path) {
+        if (!file_exists($path)) continue;
+        $data = json_decode(file_get_contents($path), true);
+        if (is_array($data)) return $data;
+    }
+    return file_exists($file) ? null : [];
+}
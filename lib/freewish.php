@@ -0,0 +1,89 @@
+<?php
+/**
+ * Daily free-wish claims as one bitmap file per day
+ *   private/free/YYYY-MM-DD.bits   bit (id - 1) is set once account id claimed that day
+ *   private/free/YYYY-MM-DD.times  uint32 at (id - 1) * 4: unix time of that claim
+ * Ids come from the account dictionary (lib/accountdict.php), so a check is a
+ * one-byte read and a claim is a locked one-byte test-and-set. The first claim
+ * of a day retires the files of earlier days.
+ */
+
+function freeBitmapPath($dir, $day) {
+    return $dir . '/' . $day . '.bits';
+}
+
+/**
+ * Whether account $id has claimed on $day (unlocked read)
+ */
+function freeClaimed($dir, $day, $id) {
+    $map = mmapOpen(freeBitmapPath($dir, $day));
+    if (!$map) return false;
+    $bit = $id - 1;
+    $byte = mmapByte($map, $bit >> 3);
+    return $byte !== null && (($byte >> ($bit & 7)) & 1) === 1;
+}
+
+function freeTimesPath($dir, $day) {
+    return $dir . '/' . $day . '.times';
+}
+
+/**
+ * Unix time account $id claimed its free wish on $day, or null
+ */
+function freeClaimTime($dir, $day, $id) {
+    $fp = @fopen(freeTimesPath($dir, $day), 'rb');
+    if (!$fp) return null;
+    fseek($fp, ($id - 1) * 4);
+    $bytes = fread($fp, 4);
+    fclose($fp);
+    $time = strlen((string)$bytes) === 4 ? unpack('N', $bytes)[1] : 0;
+    return $time > 0 ? $time : null;
+}
+
+/**
+ * Claim the free wish of account $id for $day; false if it was already claimed,
+ * null if the bitmap could not be opened or locked
+ */
+function freeClaim($dir, $day, $id) {
+    $path = freeBitmapPath($dir, $day);
+    $fp = @fopen($path, 'c+b');
+    if (!$fp) {
+        @mkdir($dir, 0750, true);
+        $fp = @fopen($path, 'c+b');
+        if (!$fp) return null;
+    }
+    if (!storeLock($fp, LOCK_EX)) {
+        fclose($fp);
+        return null;
+    }
+    $new = fstat($fp)['size'] === 0;
+
+    $bit = $id - 1;
+    fseek($fp, $bit >> 3);
+    $byte = fread($fp, 1);
+    $value = ($byte === '' || $byte === false) ? 0 : ord($byte);
+    $claimed = ($value >> ($bit & 7)) & 1;
+    if (!$claimed) {
+        fseek($fp, $bit >> 3);
+        fwrite($fp, chr($value | (1 << ($bit & 7))));
+        fflush($fp);
+        // Written under the bitmap lock; only the credits 'get' reads it
+        $times = @fopen(freeTimesPath($dir, $day), 'c+b');
+        if ($times) {
+            fseek($times, $bit * 4);
+            fwrite($times, pack('N', time()));
+            fclose($times);
+        }
+    }
+    flock($fp, LOCK_UN);
+    fclose($fp);
+
+    if ($new) {
+        foreach (glob($dir . '/*.{bits,times}', GLOB_BRACE) ?: [] as $old) {
+            if (pathinfo($old, PATHINFO_FILENAME) < $day) {
+                @unlink($old);
+            }
+        }
+    }
+    return !$claimed;
+}
@@ -0,0 +1,24 @@
+<?php
+/**
+ * Versioned game configuration manifest (game_config.json)
+ * Token contracts, precision and bonuses, outcomes, packs and fallback prices,
+ * shared by the client and the endpoints. Bump "version" with every edit:
+ * clients cache each version forever and only re-check the version number.
+ */
+
+function gameConfig($file) {
+    static $configs = [];
+    if (!isset($configs[$file])) {
+        $config = @json_decode(@file_get_contents($file), true);
+        $configs[$file] = is_array($config) ? $config : ['version' => 0];
+    }
+    return $configs[$file];
+}
+
+/**
+ * Tokens a result code pays out, or null if the manifest does not define it
+ */
+function gameConfigPayout($config, $resultCode) {
+    if (!isset($config['outcomes'][$resultCode])) return null;
+    return (int)($config['outcomes'][$resultCode]['amount'] ?? 0);
+}
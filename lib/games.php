@@ -0,0 +1,57 @@
+<?php
+/**
+ * Arcade game partitions
+ * Every game type gets its own log, payout queue and derived state, so each
+ * has its own files and locks and a busy game never waits on another one.
+ * The default game keeps the original top-level paths; other games live under
+ *   games/<type>/log.txt, games/<type>/payout_queue.txt   (public, like log.txt)
+ *   games/<type>/game_config.json                         (pricing/outcome manifest)
+ *   private/games/<type>/{wishes,index,cube,hll}
+ * Game types besides the default are listed in private/games.json, e.g.
+ *   ["psychic_traveller", "crystal_ball"]
+ * Credits are wallet-level and stay shared across games.
+ */
+
+define('GAME_DEFAULT', 'psychic_traveller');
+
+function isValidGameType($game) {
+    return is_string($game) && preg_match('/^[a-z0-9_]{1,32}$/', $game);
+}
+
+function gameTypes($dataDir) {
+    static $types = [];
+    if (!isset($types[$dataDir])) {
+        $listed = @json_decode(@file_get_contents($dataDir . '/private/games.json'), true);
+        $listed = is_array($listed) ? array_filter($listed, 'isValidGameType') : [];
+        $types[$dataDir] = array_values(array_unique(array_merge([GAME_DEFAULT], $listed)));
+    }
+    return $types[$dataDir];
+}
+
+/**
+ * File locations of one game's partition
+ */
+function gamePaths($dataDir, $game) {
+    if ($game === GAME_DEFAULT) {
+        $public = $dataDir;
+        $private = $dataDir . '/private';
+    } else {
+        $public = $dataDir . '/games/' . $game;
+        $private = $dataDir . '/private/games/' . $game;
+    }
+    return [
+        'log' => $public . '/log.txt',
+        'payout' => $public . '/payout_queue.txt',
+        'config' => $public . '/game_config.json',
+        'private' => $private,
+        'credits' => $dataDir . '/private/credits.json', // shared by every game
+        'wishes' => $private . '/wishes',
+        'state' => $private . '/index/log_state.json',
+        'base' => $private . '/index/log_base.dat',
+        'cube' => $private . '/cube',
+        'hll' => $private . '/hll',
+        'bloom' => $private . '/index/accounts.bloom',
+        'drift' => $private . '/index/drift.json',
+        'replica' => $private . '/index/replica.json'
+    ];
+}
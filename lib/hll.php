@@ -0,0 +1,204 @@
+<?php
+/**
+ * HyperLogLog sketches of distinct players per day and per hour
+ * A sketch is HLL_REGISTERS bytes, one register per byte, stored as
+ *   YYYY-MM-DD.hll      day sketch
+ *   YYYY-MM-DD/HH.hll   hour sketch
+ * Adding an account touches a single register in place, and sketches merge by
+ * taking the register-wise max, so any window is the union of its files.
+ */
+
+define('HLL_PRECISION', 11);                   // 2048 registers, ~2.3% standard error
+define('HLL_REGISTERS', 1 << HLL_PRECISION);
+
+/**
+ * Register index and rank (position of the first set bit) for an account
+ */
+function hllHash($account) {
+    $h = unpack('N2', md5($account, true));
+    $index = $h[1] >> (32 - HLL_PRECISION);
+    $rank = $h[2] === 0 ? 33 : 33 - strlen(decbin($h[2]));
+    return [$index, $rank];
+}
+
+function hllEmpty() {
+    return str_repeat("\0", HLL_REGISTERS);
+}
+
+/**
+ * Add an account to an in-memory sketch
+ */
+function hllAddToSketch(&$sketch, $account) {
+    list($index, $rank) = hllHash($account);
+    if (ord($sketch[$index]) < $rank) {
+        $sketch[$index] = chr($rank);
+    }
+}
+
+/**
+ * Register-wise max of two sketches
+ */
+function hllMerge($a, $b) {
+    for ($i = 0; $i < HLL_REGISTERS; $i++) {
+        if (ord($b[$i]) > ord($a[$i])) {
+            $a[$i] = $b[$i];
+        }
+    }
+    return $a;
+}
+
+/**
+ * Cardinality estimate with the small-range (linear counting) correction
+ */
+function hllEstimate($sketch) {
+    $m = HLL_REGISTERS;
+    $sum = 0.0;
+    $zeros = 0;
+    for ($i = 0; $i < $m; $i++) {
+        $r = ord($sketch[$i]);
+        $sum += 1.0 / (1 << $r);
+        if ($r === 0) $zeros++;
+    }
+    $alpha = 0.7213 / (1 + 1.079 / $m);
+    $estimate = $alpha * $m * $m / $sum;
+    if ($estimate <= 2.5 * $m && $zeros > 0) {
+        $estimate = $m * log($m / $zeros);
+    }
+    return (int)round($estimate);
+}
+
+/**
+ * Load a sketch file (missing or short files read as zero registers)
+ */
+function hllLoad($path) {
+    $data = @file_get_contents($path);
+    if ($data === false || $data === '') return hllEmpty();
+    return str_pad(substr($data, 0, HLL_REGISTERS), HLL_REGISTERS, "\0");
+}
+
+/**
+ * Raise one register of a sketch file in place if $rank is higher
+ */
+function hllUpdateFile($path, $index, $rank) {
+    $fp = @fopen($path, 'c+');
+    if (!$fp) {
+        if (!is_dir(dirname($path))) {
+            @mkdir(dirname($path), 0750, true);
+        }
+        $fp = @fopen($path, 'c+');
+        if (!$fp) return false;
+    }
+
+    // Unlocked read first: once a sketch warms up most adds change nothing
+    fseek($fp, $index);
+    $current = fread($fp, 1);
+    if ($current !== '' && $current !== false && ord($current) >= $rank) {
+        fclose($fp);
+        return true;
+    }
+
+    if (!storeLock($fp, LOCK_EX)) {
+        fclose($fp);
+        return false;
+    }
+    fseek($fp, $index);
+    $current = fread($fp, 1);
+    if ($current === '' || $current === false || ord($current) < $rank) {
+        fseek($fp, $index);
+        fwrite($fp, chr($rank));
+    }
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return true;
+}
+
+/**
+ * Record an active account in the current day and hour sketches
+ */
+function hllRecord($dir, $account, $time = null) {
+    $time = $time ?? time();
+    $day = date('Y-m-d', $time);
+    list($index, $rank) = hllHash($account);
+    hllUpdateFile("$dir/$day.hll", $index, $rank);
+    hllUpdateFile("$dir/$day/" . date('H', $time) . '.hll', $index, $rank);
+}
+
+/**
+ * Union of the sketches covering [$from, $to] (inclusive hour keys)
+ * Whole days use the day sketch; partial days merge their hour sketches
+ */
+function hllWindow($dir, $from, $to) {
+    $sketch = hllEmpty();
+    $files = 0;
+    $day = substr($from, 0, 10);
+    $lastDay = substr($to, 0, 10);
+
+    while ($day <= $lastDay) {
+        if ($from <= "{$day}T00" && $to >= "{$day}T23") {
+            if (file_exists("$dir/$day.hll")) {
+                $sketch = hllMerge($sketch, hllLoad("$dir/$day.hll"));
+                $files++;
+            }
+        } else {
+            for ($h = 0; $h < 24; $h++) {
+                $hourKey = sprintf('%sT%02d', $day, $h);
+                if ($hourKey < $from || $hourKey > $to) continue;
+                $path = sprintf('%s/%s/%02d.hll', $dir, $day, $h);
+                if (file_exists($path)) {
+                    $sketch = hllMerge($sketch, hllLoad($path));
+                    $files++;
+                }
+            }
+        }
+        $day = date('Y-m-d', strtotime("$day +1 day"));
+    }
+    return [$sketch, $files];
+}
+
+/**
+ * Rebuild derivation: hour key => sketch of accounts seen in the log
+ */
+function hllLogAdd(&$hours, $rec, $offset) {
+    $hourKey = logHourKey($rec['timestamp']);
+    if (!isset($hours[$hourKey])) {
+        $hours[$hourKey] = hllEmpty();
+    }
+    hllAddToSketch($hours[$hourKey], $rec['user']);
+}
+
+function hllLogMerge(&$hours, $part) {
+    foreach ($part as $hourKey => $sketch) {
+        $hours[$hourKey] = isset($hours[$hourKey]) ? hllMerge($hours[$hourKey], $sketch) : $sketch;
+    }
+}
+
+/**
+ * Max-merge rebuilt sketches into the stored ones, keeping activity that
+ * only credits.php saw (HLL union is idempotent, so re-running is safe)
+ */
+function hllPublish($hours, $privateDir) {
+    $dir = $privateDir . '/hll';
+    $days = [];
+    foreach ($hours as $hourKey => $sketch) {
+        $day = substr($hourKey, 0, 10);
+        $days[$day] = isset($days[$day]) ? hllMerge($days[$day], $sketch) : $sketch;
+        hllPublishFile("$dir/$day/" . substr($hourKey, 11, 2) . '.hll', $sketch);
+    }
+    foreach ($days as $day => $sketch) {
+        hllPublishFile("$dir/$day.hll", $sketch);
+    }
+}
+
+function hllPublishFile($path, $sketch) {
+    if (!is_dir(dirname($path))) {
+        mkdir(dirname($path), 0750, true);
+    }
+    $fp = fopen($path, 'c+');
+    flock($fp, LOCK_EX);
+    $current = str_pad(substr(stream_get_contents($fp), 0, HLL_REGISTERS), HLL_REGISTERS, "\0");
+    rewind($fp);
+    fwrite($fp, hllMerge($current, $sketch));
+    fflush($fp);
+    flock($fp, LOCK_UN);
+    fclose($fp);
+}
@@ -0,0 +1,9 @@
+<?php
+/**
+ * Security: Block direct access to the library directory
+ * Shared PHP includes are never served directly
+ */
+
+http_response_code(403);
+header('Content-Type: text/plain');
+die('403 Forbidden - Access Denied');
@@ -0,0 +1,392 @@
+<?php
+/**
+ * Derived state over the public game log (log.txt)
+ * Per-user stats and a sparse hour -> byte offset index, checkpointed so that
+ * readers only scan the tail appended since the last build
+ */
+
+define('LOG_STATE_VERSION', 1);
+define('LOG_CHECKPOINT_TAIL', 1048576); // Readers persist a new checkpoint once the unindexed tail passes 1 MB
+// Derivations whose totals for compacted lines are kept in the base file; the
+// sketch and filter publishers union into their stores, so they lose nothing,
+// and sparse offsets into dropped lines mean nothing
+define('LOG_BASE_DERIVATIONS', ['users', 'cube']);
+
+/**
+ * Derivations maintained from the log, in merge order
+ * Each entry is [add(&$state, $record, $offset), merge(&$state, $partial), publish]
+ * Derivations with a publish callback (publish($state, $privateDir)) are only
+ * computed by bin/rebuild.php and written to their own store; the rest live
+ * in the checkpoint read by request handlers.
+ */
+function logDerivations() {
+    return [
+        'users' => ['logUsersAdd', 'logUsersMerge', null],
+        'sparse' => ['logSparseAdd', 'logSparseMerge', null],
+        'cube' => ['cubeLogAdd', 'cubeLogMerge', 'cubePublish'],
+        'players' => ['hllLogAdd', 'hllLogMerge', 'hllPublish'],
+        'accounts' => ['bloomLogAdd', 'bloomLogMerge', 'bloomPublish']
+    ];
+}
+
+/**
+ * Parse one log line into a record (null for comments, malformed lines and
+ * lines whose integrity frame does not verify)
+ */
+function parseLogLine($line) {
+    $line = unframeRecord($line);
+    if ($line === null || $line === '' || $line[0] === '#') return null;
+
+    $parts = array_map('trim', explode('|', $line));
+    if (count($parts) < 4) return null;
+
+    return [
+        'timestamp' => $parts[0],
+        'user' => $parts[1],
+        'result' => $parts[2],
+        'tokens' => intval($parts[3]),
+        'memo' => $parts[4] ?? ''
+    ];
+}
+
+/**
+ * Hour bucket for a log timestamp (server-local hour as written by date('c'))
+ */
+function logHourKey($timestamp) {
+    return substr($timestamp, 0, 13);
+}
+
+/**
+ * Per-user counters, same semantics as the original full-scan getStats()
+ */
+function logUsersAdd(&$users, $rec, $offset) {
+    $user = $rec['user'];
+    if (!isset($users[$user])) {
+        $users[$user] = ['wishes' => 0, 'wins' => 0, 'tokens' => 0, 'free_spins' => 0, 'losses' => 0];
+    }
+
+    $result = $rec['result'];
+    $users[$user]['wishes']++;
+
+    if ($result === 'WIN' || $result === 'WISH_GRANTED') {
+        $users[$user]['wins']++;
+    } elseif ($result === 'TOKENS' || strpos($result, 'TOKENS_') !== false) {
+        $users[$user]['tokens'] += $rec['tokens'];
+    } elseif ($result === 'FREE_SPIN') {
+        $users[$user]['free_spins']++;
+    } elseif ($result === 'LOSE' || $result === 'TRY_AGAIN') {
+        $users[$user]['losses']++;
+    }
+}
+
+function logUsersMerge(&$users, $part) {
+    foreach ($part as $user => $s) {
+        if (!isset($users[$user])) {
+            $users[$user] = $s;
+            continue;
+        }
+        foreach ($s as $k => $v) {
+            $users[$user][$k] += $v;
+        }
+    }
+}
+
+/**
+ * Sparse index: byte offset of the first line logged in each hour
+ */
+function logSparseAdd(&$sparse, $rec, $offset) {
+    $hour = logHourKey($rec['timestamp']);
+    if (!isset($sparse[$hour])) {
+        $sparse[$hour] = $offset;
+    }
+}
+
+function logSparseMerge(&$sparse, $part) {
+    // Partials are merged in file order, so the first offset seen wins
+    foreach ($part as $hour => $offset) {
+        if (!isset($sparse[$hour])) {
+            $sparse[$hour] = $offset;
+        }
+    }
+}
+
+/**
+ * Empty derived state covering zero bytes of the log
+ */
+function logEmptyState($logFile = null, $withPublished = false) {
+    $derived = [];
+    foreach (logDerivations() as $name => $fns) {
+        if ($fns[2] === null || $withPublished) {
+            $derived[$name] = [];
+        }
+    }
+    return [
+        'version' => LOG_STATE_VERSION,
+        'log_inode' => $logFile && file_exists($logFile) ? fileinode($logFile) : 0,
+        'log_offset' => 0,
+        'lines' => 0,
+        'built_at' => null,
+        'derived' => $derived
+    ];
+}
+
+/**
+ * Scan complete lines in [$start, $end) and fold them into $state
+ * A trailing line without its newline is left for the next scan
+ */
+function logScanRange($file, $start, $end, $state = null, $withPublished = false) {
+    if ($state === null) {
+        $state = logEmptyState(null, $withPublished);
+        $state['log_offset'] = $start;
+    }
+
+    $fp = @fopen($file, 'rb');
+    if (!$fp) return $state;
+
+    $derivations = array_intersect_key(logDerivations(), $state['derived']);
+    fseek($fp, $start);
+    $pos = $start;
+
+    while ($pos < $end && ($line = fgets($fp)) !== false) {
+        if (substr($line, -1) !== "\n") break;
+
+        $rec = parseLogLine($line);
+        if ($rec !== null) {
+            foreach ($derivations as $name => $fns) {
+                $fns[0]($state['derived'][$name], $rec, $pos);
+            }
+            $state['lines']++;
+        }
+        $pos += strlen($line);
+    }
+    fclose($fp);
+
+    $state['log_offset'] = $pos;
+    return $state;
+}
+
+/**
+ * Split the log into up to $parts byte ranges aligned to line boundaries
+ */
+function logSplitRanges($file, $parts, $size = null) {
+    $size = $size ?? filesize($file);
+    $parts = max(1, (int)$parts);
+    if ($size === 0) return [];
+
+    $fp = fopen($file, 'rb');
+    $bounds = [0];
+    $step = (int)ceil($size / $parts);
+
+    for ($i = 1; $i < $parts; $i++) {
+        $target = $i * $step;
+        if ($target >= $size) break;
+        fseek($fp, $target - 1);
+        // Landing exactly after a newline is already a boundary; otherwise finish the line
+        if (fgetc($fp) !== "\n") {
+            fgets($fp);
+        }
+        $boundary = min(ftell($fp), $size);
+        if ($boundary > end($bounds) && $boundary < $size) {
+            $bounds[] = $boundary;
+        }
+    }
+    fclose($fp);
+
+    $bounds[] = $size;
+    $ranges = [];
+    for ($i = 0; $i < count($bounds) - 1; $i++) {
+        $ranges[] = [$bounds[$i], $bounds[$i + 1]];
+    }
+    return $ranges;
+}
+
+/**
+ * Merge partial states in range order into one state
+ */
+function logMergePartials($partials, $logFile = null, $withPublished = false) {
+    $state = logEmptyState($logFile, $withPublished);
+    $derivations = array_intersect_key(logDerivations(), $state['derived']);
+
+    foreach ($partials as $part) {
+        foreach ($derivations as $name => $fns) {
+            $fns[1]($state['derived'][$name], $part['derived'][$name] ?? []);
+        }
+        $state['lines'] += $part['lines'];
+        $state['log_offset'] = max($state['log_offset'], $part['log_offset']);
+    }
+    return $state;
+}
+
+/**
+ * Hash of the first record line of the log (md5('') when there is none)
+ * Identifies how far the log has been compacted
+ */
+function logFirstLineHash($logFile) {
+    $fp = @fopen($logFile, 'rb');
+    if (!$fp) return md5('');
+    while (($line = fgets($fp)) !== false) {
+        if ($line !== "\n" && $line[0] !== '#') break;
+    }
+    fclose($fp);
+    return md5($line === false ? '' : $line);
+}
+
+/**
+ * Fold the aggregates of lines about to be compacted away into the base file
+ * (private/index/log_base.dat), a partial in logMergePartials() form that
+ * bin/rebuild.php merges ahead of the log. $firstLine is the hash of the line
+ * that will open the log afterwards. The previous base is kept alongside, so
+ * a compaction that dies before renaming the new log in still finds its match.
+ */
+function logBaseAdd($baseFile, $dropped, $firstLine) {
+    $previous = logReadBase($baseFile);
+    $base = $previous ?? ['first_line' => null, 'lines' => 0, 'log_offset' => 0, 'derived' => []];
+    unset($base['previous']);
+
+    $derivations = array_intersect_key(logDerivations(), array_flip(LOG_BASE_DERIVATIONS));
+    foreach ($derivations as $name => $fns) {
+        if (!isset($base['derived'][$name])) {
+            $base['derived'][$name] = [];
+        }
+        $fns[1]($base['derived'][$name], $dropped['derived'][$name] ?? []);
+    }
+    $base['lines'] += $dropped['lines'];
+    $base['first_line'] = $firstLine;
+    if ($previous !== null) {
+        unset($previous['previous']);
+        $base['previous'] = $previous;
+    }
+
+    if (!is_dir(dirname($baseFile))) {
+        mkdir(dirname($baseFile), 0750, true);
+    }
+    $tmp = $baseFile . '.' . getmypid() . '.tmp';
+    if (file_put_contents($tmp, serialize($base)) === false) {
+        return false;
+    }
+    return rename($tmp, $baseFile);
+}
+
+/**
+ * Undo the last logBaseAdd() when the compaction it was written for did not happen
+ */
+function logBaseRevert($baseFile) {
+    $base = logReadBase($baseFile);
+    if ($base === null) return true;
+    if (!isset($base['previous'])) return @unlink($baseFile);
+    $tmp = $baseFile . '.' . getmypid() . '.tmp';
+    if (file_put_contents($tmp, serialize($base['previous'])) === false) {
+        return false;
+    }
+    return rename($tmp, $baseFile);
+}
+
+function logReadBase($baseFile) {
+    $base = @unserialize((string)@file_get_contents($baseFile));
+    return is_array($base) ? $base : null;
+}
+
+/**
+ * Base partial matching the current log: null when the log was never
+ * compacted, false when a base exists but matches neither the last nor the
+ * previous compaction (log restored or replaced; rebuilding would lose totals)
+ */
+function logLoadBase($baseFile, $logFile) {
+    $base = logReadBase($baseFile);
+    if ($base === null) return null;
+    $first = logFirstLineHash($logFile);
+    if ($base['first_line'] === $first) return $base;
+    if (isset($base['previous']) && $base['previous']['first_line'] === $first) return $base['previous'];
+    return false;
+}
+
+/**
+ * Load the checkpoint, discarding it if the log was replaced or truncated
+ */
+function logLoadState($stateFile, $logFile) {
+    $empty = logEmptyState($logFile);
+    if (!file_exists($stateFile)) return $empty;
+
+    $state = json_decode(file_get_contents($stateFile), true);
+    if (!is_array($state) || ($state['version'] ?? 0) !== LOG_STATE_VERSION) return $empty;
+    if (!file_exists($logFile)) return $empty;
+    clearstatcache(true, $logFile);
+    if ($state['log_inode'] !== fileinode($logFile) || $state['log_offset'] > filesize($logFile)) return $empty;
+
+    foreach ($empty['derived'] as $name => $unused) {
+        if (!isset($state['derived'][$name])) return $empty;
+    }
+    return $state;
+}
+
+/**
+ * Atomically replace the checkpoint (write temp file, then rename)
+ */
+function logSaveState($stateFile, $state) {
+    $dir = dirname($stateFile);
+    if (!is_dir($dir)) {
+        mkdir($dir, 0750, true);
+    }
+    $state['built_at'] = date('c');
+    $tmp = $stateFile . '.' . getmypid() . '.tmp';
+    if (file_put_contents($tmp, json_encode($state)) === false) {
+        return false;
+    }
+    return rename($tmp, $stateFile);
+}
+
+/**
+ * Checkpoint plus everything appended since, for request-time readers
+ */
+function logCurrentState($logFile, $stateFile) {
+    $fp = @fopen($logFile, 'rb');
+    if (!$fp) return logLoadState($stateFile, $logFile);
+
+    // Shared lock: retention and restores replace the log by rename and rewrite
+    // the checkpoint while holding it exclusively. If that takes too long, answer
+    // from the checkpoint alone rather than queueing behind it. Once the lock is
+    // ours, the path must still name the file we opened; if not, reopen.
+    storeRead();
+    for ($attempt = 0; ; $attempt++) {
+        if (!storeLock($fp, LOCK_SH)) {
+            fclose($fp);
+            return logLoadState($stateFile, $logFile);
+        }
+        clearstatcache(true, $logFile);
+        if (fstat($fp)['ino'] === @fileinode($logFile) || $attempt >= 2) break;
+        flock($fp, LOCK_UN);
+        fclose($fp);
+        $fp = @fopen($logFile, 'rb');
+        if (!$fp) return logLoadState($stateFile, $logFile);
+    }
+    $state = logLoadState($stateFile, $logFile);
+    $size = fstat($fp)['size'];
+    $tail = $size - $state['log_offset'];
+    if ($tail <= 0) {
+        flock($fp, LOCK_UN);
+        fclose($fp);
+        return $state;
+    }
+
+    $state = logScanRange($logFile, $state['log_offset'], $size, $state);
+    flock($fp, LOCK_UN);
+    fclose($fp);
+
+    // Advance the checkpoint when the tail gets long, unless another reader already is
+    if ($tail >= LOG_CHECKPOINT_TAIL) {
+        if (!is_dir(dirname($stateFile))) {
+            @mkdir(dirname($stateFile), 0750, true);
+        }
+        $lock = @fopen($stateFile . '.lock', 'c');
+        if ($lock && flock($lock, LOCK_EX | LOCK_NB)) {
+            // Not if a compaction replaced the log since the scan
+            clearstatcache(true, $logFile);
+            if ($state['log_inode'] === @fileinode($logFile)) {
+                logSaveState($stateFile, $state);
+            }
+            flock($lock, LOCK_UN);
+        }
+        if ($lock) fclose($lock);
+    }
+    return $state;
+}
@@ -0,0 +1,7 @@
+#define FFI_SCOPE "ZOLTARAN_MMAP"
+#define FFI_LIB "libc.so.6"
+
+int open(const char *pathname, int flags);
+int close(int fd);
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+int munmap(void *addr, size_t length);
@@ -0,0 +1,150 @@
+<?php
+/**
+ * Read-only access to the fixed-width index files
+ * (accounts.dict, accounts.bloom, free-wish bitmaps, wish posting lists)
+ * With FFI available the file is mmap()ed once per request and lookups read
+ * straight from the mapping: no seek/read syscalls, and a single byte probe
+ * copies nothing. Without FFI (or with ZOLTARAN_MMAP=0) the same calls go
+ * through one open stream per file. Reads past the end of the file are short,
+ * as with fread(). Writers keep using streams and locks; the mapping is
+ * shared, so their in-place writes are visible, and a file that grew is
+ * mapped again. These files only grow or are replaced by rename; truncating
+ * one in place would fault readers that still map the old length.
+ * Under PHP-FPM, FFI is only allowed from preload by default
+ * (ffi.enable=preload): preload.php loads lib/mmap.h into the ZOLTARAN_MMAP
+ * scope. The CLI can load the header directly.
+ */
+
+define('MMAP_PROT_READ', 1);
+define('MMAP_SHARED', 1);
+
+/**
+ * 'auto' (FFI when available) or 'stream'; pass a mode to switch (bin/mmap_bench.php)
+ */
+function mmapMode($mode = null) {
+    static $current = null;
+    if ($current === null) {
+        $current = getenv('ZOLTARAN_MMAP') === '0' ? 'stream' : 'auto';
+    }
+    if ($mode !== null) {
+        $current = $mode;
+    }
+    return $current;
+}
+
+function mmapFfi() {
+    static $ffi = false;
+    if ($ffi === false) {
+        $ffi = null;
+        if (extension_loaded('FFI')) {
+            try {
+                $ffi = FFI::scope('ZOLTARAN_MMAP');
+            } catch (Throwable $e) {
+                try {
+                    $ffi = FFI::load(__DIR__ . '/mmap.h');
+                } catch (Throwable $e) {
+                    $ffi = null;
+                }
+            }
+        }
+    }
+    return mmapMode() === 'auto' ? $ffi : null;
+}
+
+/**
+ * Readers opened by this request, closed at shutdown
+ */
+function &mmapMaps() {
+    static $maps = null;
+    if ($maps === null) {
+        $maps = [];
+        register_shutdown_function('mmapCloseAll');
+    }
+    return $maps;
+}
+
+/**
+ * Unmap and close every cached reader (request end, or between bench iterations)
+ */
+function mmapCloseAll() {
+    $maps = &mmapMaps();
+    foreach ($maps as $map) {
+        mmapClose($map);
+    }
+    $maps = [];
+}
+
+/**
+ * Reader for $file, or null if it does not exist; cached for the request
+ */
+function mmapOpen($file) {
+    $maps = &mmapMaps();
+    clearstatcache(true, $file);
+    $size = @filesize($file);
+    $key = mmapMode() . ':' . $file;
+    if ($size === false) {
+        if (isset($maps[$key])) {
+            mmapClose($maps[$key]);
+            unset($maps[$key]);
+        }
+        return null;
+    }
+    if (isset($maps[$key]) && $maps[$key]['size'] === $size) {
+        return $maps[$key];
+    }
+    if (isset($maps[$key])) {
+        mmapClose($maps[$key]);
+    }
+
+    $map = ['size' => $size];
+    $ffi = mmapFfi();
+    if ($ffi !== null && $size > 0) {
+        $fd = $ffi->open($file, 0);
+        if ($fd >= 0) {
+            $addr = $ffi->mmap(null, $size, MMAP_PROT_READ, MMAP_SHARED, $fd, 0);
+            $ffi->close($fd);
+            if ($ffi->cast('intptr_t', $addr)->cdata !== -1) {
+                $map += ['ffi' => $ffi, 'addr' => $addr, 'bytes' => $ffi->cast('unsigned char *', $addr)];
+            }
+        }
+    }
+    if (!isset($map['bytes'])) {
+        $map['fp'] = @fopen($file, 'rb');
+        if (!$map['fp']) return null;
+    }
+    return $maps[$key] = $map;
+}
+
+function mmapClose($map) {
+    if (isset($map['addr'])) {
+        $map['ffi']->munmap($map['addr'], $map['size']);
+    } elseif (isset($map['fp'])) {
+        fclose($map['fp']);
+    }
+}
+
+/**
+ * Up to $length bytes at $offset
+ */
+function mmapRead($map, $offset, $length) {
+    $length = min($length, $map['size'] - $offset);
+    if ($length <= 0) return '';
+    if (isset($map['bytes'])) {
+        return FFI::string($map['bytes'] + $offset, $length);
+    }
+    fseek($map['fp'], $offset);
+    return (string)fread($map['fp'], $length);
+}
+
+/**
+ * Byte value at $offset, or null past the end
+ */
+function mmapByte($map, $offset) {
+    if ($offset >= $map['size']) return null;
+    if (isset($map['bytes'])) {
+        return $map['bytes'][$offset];
+    }
+    fseek($map['fp'], $offset);
+    $byte = fread($map['fp'], 1);
+    return $byte === '' || $byte === false ? null : ord($byte);
+}
@@ -0,0 +1,90 @@
+<?php
+/**
+ * Sampling profiler for the request entry points
+ * A sampled request is profiled with excimer (timer signals, no cost between
+ * samples). Without the extension nothing is profiled: a tick fallback would
+ * need declare(ticks=1) in the entry points, which taxes every request.
+ * Which requests are sampled comes from private/profile.json, e.g.
+ *   {"period_ms": 10, "actions": {"log_result": 0.01, "credits:use_free": 0.05, "*": 0}}
+ * Keys are an action or "<entry>:<action>", "*" is the default, values the
+ * fraction of requests sampled. Without the file nothing is profiled.
+ * Samples are appended as collapsed stacks ("entry;action;frame;... count")
+ * to private/profiles/YYYY-MM-DD/<entry>-<action>.folded; bin/flamegraph.php
+ * merges and renders them, and bin/retention.php removes old days.
+ * Only the entry point's known actions are sampled, so request input cannot
+ * add files.
+ */
+
+define('PROFILER_DEFAULT_PERIOD_MS', 10);
+
+function profilerConfig($file) {
+    static $configs = [];
+    if (!isset($configs[$file])) {
+        $config = @json_decode(@file_get_contents($file), true);
+        $configs[$file] = is_array($config) ? $config : [];
+    }
+    return $configs[$file];
+}
+
+/**
+ * Sample this request with probability configured for the action; actions
+ * outside $knownActions are never sampled
+ */
+function profilerStart($configFile, $outDir, $entry, $action, $knownActions) {
+    if (!class_exists('ExcimerProfiler') || !in_array($action, $knownActions, true)) {
+        return false;
+    }
+    $config = profilerConfig($configFile);
+    $actions = $config['actions'] ?? [];
+    $rate = (float)($actions["$entry:$action"] ?? $actions[$action] ?? $actions['*'] ?? 0);
+    if ($rate <= 0 || mt_rand() / mt_getrandmax() >= $rate) {
+        return false;
+    }
+    $period = max(1, (float)($config['period_ms'] ?? PROFILER_DEFAULT_PERIOD_MS)) / 1000;
+    $prefix = "$entry;$action";
+    $path = sprintf('%s/%s/%s-%s.folded', $outDir, date('Y-m-d'), $entry, $action);
+
+    $profiler = new ExcimerProfiler();
+    $profiler->setPeriod($period);
+    $profiler->setEventType(EXCIMER_REAL);
+    $profiler->start();
+    register_shutdown_function(function() use ($profiler, $prefix, $path) {
+        $profiler->stop();
+        $lines = [];
+        foreach (explode("\n", trim($profiler->getLog()->formatCollapsed())) as $line) {
+            if ($line !== '') {
+                $lines[] = $prefix . ';' . $line;
+            }
+        }
+        profilerWrite($path, $lines);
+    });
+    return true;
+}
+
+function profilerWrite($path, $lines) {
+    if (!$lines) return;
+    $data = implode("\n", $lines) . "\n";
+    if (@file_put_contents($path, $data, FILE_APPEND | LOCK_EX) === false) {
+        @mkdir(dirname($path), 0750, true);
+        @file_put_contents($path, $data, FILE_APPEND | LOCK_EX);
+    }
+}
+
+/**
+ * Sum collapsed stack files into stack => count
+ */
+function profilerMerge($files) {
+    $stacks = [];
+    foreach ($files as $file) {
+        $fp = @fopen($file, 'rb');
+        if (!$fp) continue;
+        while (($line = fgets($fp)) !== false) {
+            $pos = strrpos(rtrim($line), ' ');
+            if ($pos === false) continue;
+            $stack = substr($line, 0, $pos);
+            $stacks[$stack] = ($stacks[$stack] ?? 0) + (int)substr($line, $pos + 1);
+        }
+        fclose($fp);
+    }
+    return $stacks;
+}
@@ -0,0 +1,141 @@
+<?php
+/**
+ * Log shipping from the primary to read-only replicas
+ * A replica copies log.txt byte for byte: it asks the primary for the bytes
+ * after its own length, appends them, and advances its derived state
+ * (checkpoint and accounts filter) from them. Every chunk carries its own
+ * checksum plus one of the bytes just before its offset; when the latter
+ * differs the primary log was compacted or replaced, and the replica starts
+ * over from offset 0.
+ * private/index/replica.json records when the replica last reached the
+ * primary's end; replicas refuse reads once that is older than the allowed lag.
+ */
+
+define('REPL_CHUNK', 1048576);
+define('REPL_CHECK_BYTES', 64);
+define('REPL_MAX_LAG', 5); // seconds, overridden by ZOLTARAN_MAX_STALENESS
+
+/**
+ * Checksum of the REPL_CHECK_BYTES bytes before $offset
+ */
+function replCheck($fp, $offset) {
+    $start = max(0, $offset - REPL_CHECK_BYTES);
+    fseek($fp, $start);
+    return hash('crc32b', $offset > $start ? fread($fp, $offset - $start) : '');
+}
+
+/**
+ * Primary side: complete lines from $offset, at most $max bytes
+ * Returns ['size', 'offset', 'check', 'crc', 'data'] or null when the log is missing
+ */
+function replRead($file, $offset, $max = REPL_CHUNK) {
+    $fp = @fopen($file, 'rb');
+    if (!$fp) return null;
+    flock($fp, LOCK_SH);
+    $size = fstat($fp)['size'];
+    $offset = min(max(0, (int)$offset), $size);
+    $check = replCheck($fp, $offset);
+    fseek($fp, $offset);
+    $data = $size > $offset ? fread($fp, min($max, $size - $offset)) : '';
+    flock($fp, LOCK_UN);
+    fclose($fp);
+
+    // Only ship whole lines; a line longer than $max goes out on its own
+    $end = strrpos($data, "\n");
+    if ($end === false && $offset + strlen($data) < $size) {
+        return replRead($file, $offset, $max * 2);
+    }
+    $data = $end === false ? '' : substr($data, 0, $end + 1);
+    return ['size' => $size, 'offset' => $offset, 'check' => $check, 'crc' => hash('crc32b', $data), 'data' => $data];
+}
+
+/**
+ * Replica side: fetch a chunk from a primary directory or psychic_queue.php URL
+ */
+function replFetch($source, $offset, $game = GAME_DEFAULT) {
+    if (!preg_match('#^https?://#', $source)) {
+        return replRead(gamePaths(rtrim($source, '/'), $game)['log'], $offset);
+    }
+    $context = stream_context_create(['http' => [
+        'method' => 'POST',
+        'header' => "Content-Type: application/json\r\nX-Admin-Token: " . getenv('ZOLTARAN_ADMIN_TOKEN') . "\r\n",
+        'content' => json_encode(['action' => 'replicate', 'game' => $game, 'offset' => $offset]),
+        'timeout' => 10
+    ]]);
+    $response = json_decode(@file_get_contents($source, false, $context), true);
+    if (empty($response['success'])) return null;
+    $response['data'] = base64_decode($response['data']);
+    return $response;
+}
+
+/**
+ * Append a fetched chunk to the local log and fold it into the derived state
+ * Returns the number of bytes applied, or false when the logs have diverged
+ */
+function replApply($logFile, $stateFile, $bloomFile, $chunk) {
+    $fp = fopen($logFile, 'c+');
+    flock($fp, LOCK_EX);
+    $size = fstat($fp)['size'];
+    if ($chunk['offset'] !== $size || replCheck($fp, $size) !== $chunk['check']) {
+        flock($fp, LOCK_UN);
+        fclose($fp);
+        return false;
+    }
+
+    // Corrupt lines are shipped as they are (readers skip them); the chunk itself must arrive intact
+    $data = $chunk['data'];
+    if (hash('crc32b', $data) !== $chunk['crc']) {
+        flock($fp, LOCK_UN);
+        fclose($fp);
+        return 0;
+    }
+    fseek($fp, $size);
+    fwrite($fp, $data);
+    fflush($fp);
+    flock($fp, LOCK_UN);
+    fclose($fp);
+
+    if ($data !== '') {
+        foreach (explode("\n", $data) as $line) {
+            $rec = parseLogLine($line);
+            if ($rec !== null) {
+                bloomAdd($bloomFile, $rec['user']);
+            }
+        }
+        $state = logLoadState($stateFile, $logFile);
+        logSaveState($stateFile, logScanRange($logFile, $state['log_offset'], $size + strlen($data), $state));
+    }
+    return strlen($data);
+}
+
+/**
+ * Start over after the primary log was compacted or replaced
+ */
+function replReset($logFile, $stateFile) {
+    $fp = fopen($logFile, 'c+');
+    flock($fp, LOCK_EX);
+    ftruncate($fp, 0);
+    @unlink($stateFile);
+    flock($fp, LOCK_UN);
+    fclose($fp);
+}
+
+function replSaveStatus($statusFile, $status) {
+    $tmp = $statusFile . '.' . getmypid() . '.tmp';
+    file_put_contents($tmp, json_encode($status));
+    rename($tmp, $statusFile);
+}
+
+/**
+ * Seconds since the replica last held everything the primary had, or null if never
+ */
+function replLag($statusFile) {
+    $status = @json_decode(@file_get_contents($statusFile), true);
+    if (!isset($status['caught_up_at'])) return null;
+    return max(0, microtime(true) - $status['caught_up_at']);
+}
+
+function replMaxLag() {
+    $lag = getenv('ZOLTARAN_MAX_STALENESS');
+    return $lag !== false && $lag !== '' ? (float)$lag : REPL_MAX_LAG;
+}
@@ -0,0 +1,419 @@
+<?php
+/**
+ * Retention and compaction for every store
+ * Policies (age in days, size in bytes, count in records) are the defaults
+ * below overridden per store by private/retention.json. Only bin/retention.php
+ * calls these functions; nothing here runs inside an API request.
+ * Every function returns a report array and changes nothing when $dryRun is set.
+ */
+
+function retentionDefaultPolicies() {
+    return [
+        // Whole sealed segments are dropped, oldest first
+        'wishes' => ['max_age_days' => 365, 'max_bytes' => null, 'max_count' => null],
+        // Public log; the checkpoint keeps aggregates of dropped lines (off by default)
+        'log' => ['max_age_days' => null, 'max_bytes' => null],
+        // Settled payout lines only; PENDING lines are never dropped
+        'payout' => ['max_age_days' => 90],
+        // Per-account credits history entries
+        'credits_history' => ['max_age_days' => null, 'max_count' => 100],
+        // Hourly sketches/cells; day sketches and month files keep the totals
+        'hll_hours' => ['max_age_days' => 35],
+        'cube_days' => ['max_age_days' => 400],
+        // Sampled profiles (private/profiles/YYYY-MM-DD/)
+        'profiles' => ['max_age_days' => 14]
+    ];
+}
+
+function retentionPolicies($privateDir) {
+    $policies = retentionDefaultPolicies();
+    $overrides = @json_decode(@file_get_contents($privateDir . '/retention.json'), true);
+    foreach (is_array($overrides) ? $overrides : [] as $store => $policy) {
+        if (isset($policies[$store]) && is_array($policy)) {
+            $policies[$store] = array_replace($policies[$store], $policy);
+        }
+    }
+    return $policies;
+}
+
+/**
+ * Cutoff instant (unix time) for an age policy, or null when unset
+ * Stored timestamps carry their writer's offset, so they are compared as
+ * instants (wishTime()), never as strings.
+ */
+function retentionCutoff($policy, $now) {
+    if (empty($policy['max_age_days'])) return null;
+    return $now - (int)$policy['max_age_days'] * 86400;
+}
+
+/**
+ * Drop the oldest sealed wish segments that violate the policy and compact
+ * the account/IP lists that pointed into them
+ */
+function retentionWishes($dir, $policy, $now, $dryRun) {
+    $report = ['segments' => 0, 'records' => 0, 'lists' => 0];
+    if (!is_dir($dir)) return $report;
+
+    $lock = fopen($dir . '/.lock', 'c');
+    flock($lock, LOCK_EX);
+
+    $manifest = segLoadManifest($dir);
+    $head = segLoadHead($dir);
+    $totalRecords = $head['count'];
+    $totalBytes = $head['bytes'];
+    foreach ($manifest['segments'] as $segment) {
+        $totalRecords += $segment['count'];
+        $totalBytes += $segment['bytes'];
+    }
+
+    $cutoff = retentionCutoff($policy, $now);
+    $drop = [];
+    foreach ($manifest['segments'] as $segment) {
+        $expired = $cutoff !== null && wishTime($segment['last_ts'] ?? null) < $cutoff;
+        $tooMany = !empty($policy['max_count']) && $totalRecords - $segment['count'] >= $policy['max_count'];
+        $tooBig = !empty($policy['max_bytes']) && $totalBytes - $segment['bytes'] >= $policy['max_bytes'];
+        if (!$expired && !$tooMany && !$tooBig) break;
+
+        $drop[] = $segment;
+        $totalRecords -= $segment['count'];
+        $totalBytes -= $segment['bytes'];
+    }
+
+    if ($drop && !$dryRun) {
+        // Collect the lists that reference dropped segments before the data goes away
+        $lists = [];
+        foreach ($drop as $segment) {
+            segScan($dir, $segment['segment'], $segment['bytes'], function($record) use (&$lists, $dir) {
+                if (!empty($record['user'])) {
+                    $lists[wishPostingPath($dir, 'user', $record['user'])] = true;
+                }
+                $ip = wishPackIp($record['ip'] ?? '');
+                if ($ip !== null) {
+                    $lists[wishPostingPath($dir, 'ip', $ip)] = true;
+                }
+            });
+        }
+
+        $manifest['segments'] = array_slice($manifest['segments'], count($drop));
+        segWriteJson($dir . '/manifest.json', $manifest);
+
+        $lastDropped = end($drop)['segment'];
+        foreach (array_keys($lists) as $path) {
+            retentionCompactPostings($path, $lastDropped);
+        }
+        foreach ($drop as $segment) {
+            @unlink(segPath($dir, $segment['segment']));
+            @unlink(segPath($dir, $segment['segment'], 'inv'));
+        }
+        $report['lists'] = count($lists);
+    }
+
+    flock($lock, LOCK_UN);
+    fclose($lock);
+
+    $report['segments'] = count($drop);
+    foreach ($drop as $segment) {
+        $report['records'] += $segment['count'];
+    }
+    return $report;
+}
+
+/**
+ * Rewrite a posting list without entries for segments <= $lastDropped
+ * Lists are appended in id order, so the dropped entries are a prefix
+ */
+function retentionCompactPostings($path, $lastDropped) {
+    $raw = @file_get_contents($path);
+    if ($raw === false) return;
+
+    $entries = intdiv(strlen($raw), WISH_POSTING_SIZE);
+    $keep = $entries;
+    for ($i = 0; $i < $entries; $i++) {
+        $segment = unpack('N', substr($raw, $i * WISH_POSTING_SIZE + 4, 4))[1];
+        if ($segment > $lastDropped) {
+            $keep = $i;
+            break;
+        }
+    }
+
+    if ($keep >= $entries) {
+        @unlink($path);
+        return;
+    }
+    if ($keep > 0) {
+        $tmp = $path . '.' . getmypid() . '.tmp';
+        file_put_contents($tmp, substr($raw, $keep * WISH_POSTING_SIZE, ($entries - $keep) * WISH_POSTING_SIZE));
+        rename($tmp, $path);
+    }
+}
+
+/**
+ * Length of the leading comment/blank block of a line-oriented file
+ */
+function retentionHeaderLength($fp) {
+    rewind($fp);
+    $length = 0;
+    while (($line = fgets($fp)) !== false) {
+        if ($line !== "\n" && $line[0] !== '#') break;
+        $length += strlen($line);
+    }
+    return $length;
+}
+
+/**
+ * Write the replacement of $file to a synced temp file next to it; $write($out)
+ * returns false on failure. Returns the temp path or false.
+ */
+function retentionWriteReplacement($file, $write) {
+    $tmp = $file . '.' . getmypid() . '.tmp';
+    $out = @fopen($tmp, 'wb');
+    if (!$out) return false;
+    $ok = $write($out) && storeSync($out);
+    fclose($out);
+    if (!$ok) {
+        @unlink($tmp);
+        return false;
+    }
+    @chmod($tmp, fileperms($file) & 0777);
+    return $tmp;
+}
+
+/**
+ * Compact log.txt, archiving the dropped lines
+ * Runs under LOCK_EX on the log so appenders and checkpoint readers wait; the
+ * checkpoint is first advanced to the end of the log, so its aggregates keep
+ * counting the dropped lines. The header and the retained tail are written
+ * to a temp file that replaces the log by rename, so a crash leaves the old
+ * log or the new one, never a half-moved one; storeAppend() and the
+ * checkpoint readers reopen when the inode changes. The dropped lines'
+ * totals go to the base file, which bin/rebuild.php starts from, just before
+ * the rename: the base keeps its previous entry, which still matches the old
+ * log if the rename never happens, and it is reverted when the rename fails.
+ */
+function retentionLog($logFile, $stateFile, $baseFile, $archiveDir, $policy, $now, $dryRun) {
+    $report = ['bytes' => 0];
+    $cutoff = retentionCutoff($policy, $now);
+    if (($cutoff === null && empty($policy['max_bytes'])) || !file_exists($logFile)) return $report;
+
+    $fp = fopen($logFile, 'r+');
+    flock($fp, LOCK_EX);
+    $size = fstat($fp)['size'];
+    $headerLength = retentionHeaderLength($fp);
+
+    $state = logLoadState($stateFile, $logFile);
+    $state = logScanRange($logFile, $state['log_offset'], $size, $state);
+
+    // First line to keep: the oldest hour at or after the cutoff, and/or enough to fit max_bytes
+    $cut = $headerLength;
+    if ($cutoff !== null) {
+        $cut = $state['log_offset'];
+        $cutoffHour = logHourKey(date('c', $cutoff));
+        foreach ($state['derived']['sparse'] as $hour => $offset) {
+            if ((string)$hour >= $cutoffHour) {
+                $cut = min($cut, $offset);
+            }
+        }
+    }
+    if (!empty($policy['max_bytes']) && $size - $cut > $policy['max_bytes']) {
+        fseek($fp, $size - $policy['max_bytes']);
+        fgets($fp);
+        $cut = ftell($fp);
+    }
+    $cut = min(max($cut, $headerLength), $state['log_offset']);
+    $report['bytes'] = $cut - $headerLength;
+
+    if ($report['bytes'] > 0 && !$dryRun) {
+        if (!is_dir($archiveDir)) {
+            mkdir($archiveDir, 0750, true);
+        }
+        $gz = gzopen(sprintf('%s/log-%s.txt.gz', $archiveDir, date('Ymd-His', $now)), 'wb6');
+        fseek($fp, $headerLength);
+        for ($left = $cut - $headerLength; $left > 0; $left -= strlen($chunk)) {
+            $chunk = fread($fp, min(1048576, $left));
+            gzwrite($gz, $chunk);
+        }
+        gzclose($gz);
+
+        $tmp = retentionWriteReplacement($logFile, function($out) use ($fp, $headerLength, $cut, $size) {
+            foreach ([[0, $headerLength], [$cut, $size]] as [$from, $to]) {
+                fseek($fp, $from);
+                for ($left = $to - $from; $left > 0; $left -= strlen($chunk)) {
+                    $chunk = fread($fp, min(1048576, $left));
+                    if ($chunk === false || $chunk === '' || !storeWrite($out, $chunk)) return false;
+                }
+            }
+            return true;
+        });
+        if ($tmp === false) {
+            flock($fp, LOCK_UN);
+            fclose($fp);
+            return ['bytes' => 0, 'error' => 'rewrite_failed'];
+        }
+
+        fseek($fp, $cut);
+        $firstLine = md5((string)fgets($fp));
+        $dropped = logScanRange($logFile, $headerLength, $cut, null, true);
+        if (!logBaseAdd($baseFile, $dropped, $firstLine)) {
+            @unlink($tmp);
+            flock($fp, LOCK_UN);
+            fclose($fp);
+            return ['bytes' => 0, 'error' => 'base_write_failed'];
+        }
+
+        // Checkpoint readers save only under this lock and only for the log they scanned
+        if (!is_dir(dirname($stateFile))) {
+            mkdir(dirname($stateFile), 0750, true);
+        }
+        $stateLock = fopen($stateFile . '.lock', 'c');
+        flock($stateLock, LOCK_EX);
+        if (!rename($tmp, $logFile)) {
+            @unlink($tmp);
+            logBaseRevert($baseFile);
+            flock($stateLock, LOCK_UN);
+            fclose($stateLock);
+            flock($fp, LOCK_UN);
+            fclose($fp);
+            return ['bytes' => 0, 'error' => 'rename_failed'];
+        }
+
+        clearstatcache(true, $logFile);
+        $state['log_inode'] = fileinode($logFile);
+        $shift = $cut - $headerLength;
+        $state['log_offset'] -= $shift;
+        foreach ($state['derived']['sparse'] as $hour => $offset) {
+            if ($offset < $cut) {
+                unset($state['derived']['sparse'][$hour]);
+            } else {
+                $state['derived']['sparse'][$hour] = $offset - $shift;
+            }
+        }
+        logSaveState($stateFile, $state);
+        flock($stateLock, LOCK_UN);
+        fclose($stateLock);
+    }
+
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return $report;
+}
+
+/**
+ * Drop settled payout lines older than the cutoff; the kept lines replace the
+ * file by rename under the append lock (storeAppend() reopens after it)
+ */
+function retentionPayout($file, $policy, $now, $dryRun) {
+    $report = ['lines' => 0];
+    $cutoff = retentionCutoff($policy, $now);
+    if ($cutoff === null || !file_exists($file)) return $report;
+
+    $fp = fopen($file, 'r+');
+    flock($fp, LOCK_EX);
+    $kept = '';
+    while (($line = fgets($fp)) !== false) {
+        // Lines that fail their checksum are kept for inspection
+        $payload = unframeRecord($line);
+        $parts = $payload === null ? [] : array_map('trim', explode('|', $payload));
+        $settled = count($parts) >= 6 && $parts[5] !== 'PENDING';
+        if ($line[0] !== '#' && $settled && wishTime($parts[0]) < $cutoff) {
+            $report['lines']++;
+            continue;
+        }
+        $kept .= $line;
+    }
+    if ($report['lines'] > 0 && !$dryRun) {
+        $tmp = retentionWriteReplacement($file, function($out) use ($kept) {
+            return storeWrite($out, $kept);
+        });
+        if ($tmp === false || !rename($tmp, $file)) {
+            if ($tmp !== false) @unlink($tmp);
+            $report = ['lines' => 0, 'error' => 'rewrite_failed'];
+        }
+    }
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return $report;
+}
+
+/**
+ * Trim per-account credits history by age and count
+ */
+function retentionCreditsHistory($creditsFile, $policy, $now, $dryRun) {
+    $report = ['entries' => 0];
+    if (!file_exists($creditsFile)) return $report;
+
+    $lock = fopen($creditsFile . '.lock', 'c');
+    flock($lock, LOCK_EX);
+
+    $credits = snapshotRead($creditsFile);
+    if (is_array($credits)) {
+        $cutoff = retentionCutoff($policy, $now);
+        foreach ($credits as $account => $record) {
+            $history = $record['history'] ?? [];
+            $before = count($history);
+            if ($cutoff !== null) {
+                $history = array_values(array_filter($history, function($entry) use ($cutoff) {
+                    return wishTime($entry['timestamp'] ?? null) >= $cutoff;
+                }));
+            }
+            if (!empty($policy['max_count']) && count($history) > $policy['max_count']) {
+                $history = array_slice($history, -$policy['max_count']);
+            }
+            $report['entries'] += $before - count($history);
+            $credits[$account]['history'] = $history;
+        }
+        if ($report['entries'] > 0 && !$dryRun) {
+            snapshotWrite($creditsFile, json_encode($credits, JSON_PRETTY_PRINT));
+        }
+    }
+
+    flock($lock, LOCK_UN);
+    fclose($lock);
+    return $report;
+}
+
+/**
+ * Remove per-day directories of hourly files (YYYY-MM-DD/ or YYYY-MM/DD.json)
+ * older than the cutoff; the day- and month-level files are kept
+ */
+function retentionHourlyFiles($paths, $dayOf, $policy, $now, $dryRun) {
+    $report = ['files' => 0];
+    $cutoff = retentionCutoff($policy, $now);
+    if ($cutoff === null) return $report;
+    $cutoffDay = date('Y-m-d', $cutoff);
+
+    foreach ($paths as $path) {
+        $day = $dayOf($path);
+        if ($day === null || $day >= $cutoffDay) continue;
+        $files = is_dir($path) ? (glob($path . '/*') ?: []) : [$path];
+        $report['files'] += count($files);
+        if ($dryRun) continue;
+        foreach ($files as $file) {
+            @unlink($file);
+        }
+        if (is_dir($path)) {
+            @rmdir($path);
+        }
+    }
+    return $report;
+}
+
+function retentionHllHours($hllDir, $policy, $now, $dryRun) {
+    return retentionHourlyFiles(glob($hllDir . '/*', GLOB_ONLYDIR) ?: [], function($path) {
+        $day = basename($path);
+        return preg_match('/^\d{4}-\d{2}-\d{2}$/', $day) ? $day : null;
+    }, $policy, $now, $dryRun);
+}
+
+function retentionProfiles($profileDir, $policy, $now, $dryRun) {
+    return retentionHourlyFiles(glob($profileDir . '/*', GLOB_ONLYDIR) ?: [], function($path) {
+        $day = basename($path);
+        return preg_match('/^\d{4}-\d{2}-\d{2}$/', $day) ? $day : null;
+    }, $policy, $now, $dryRun);
+}
+
+function retentionCubeDays($cubeDir, $policy, $now, $dryRun) {
+    return retentionHourlyFiles(glob($cubeDir . '/*/*.json') ?: [], function($path) {
+        $day = basename(dirname($path)) . '-' . basename($path, '.json');
+        return preg_match('/^\d{4}-\d{2}-\d{2}$/', $day) ? $day : null;
+    }, $policy, $now, $dryRun);
+}
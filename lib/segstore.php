@@ -0,0 +1,157 @@
+<?php
+/**
+ * Segmented append-only record store (one JSON record per line)
+ * Layout under the store directory:
+ *   seg-000001.log   records framed with a tab separator (lib/framing.php), each
+ *                    with a store-wide sequential "id"
+ *   head.json        active segment: number, first id, record count, bytes, time range
+ *   manifest.json    sealed segments, rewritten only when a segment seals
+ *   .lock            append lock
+ * A segment seals after SEG_RECORDS records and is never modified again, so
+ * per-segment index files can be built once, after it seals. Callers pass hooks
+ * that run under the append lock, so they must stay cheap:
+ *   'append' => fn($dir, $record, $location)  after every record
+ *   'seal'   => fn($dir, $segmentMeta)        when a segment fills up
+ */
+
+define('SEG_RECORDS', 4096);
+
+function segPath($dir, $segment, $ext = 'log') {
+    return sprintf('%s/seg-%06d.%s', $dir, $segment, $ext);
+}
+
+function segLoadManifest($dir) {
+    $manifest = @json_decode(@file_get_contents($dir . '/manifest.json'), true);
+    return is_array($manifest) ? $manifest : ['version' => 1, 'segments' => []];
+}
+
+function segLoadHead($dir) {
+    $head = @json_decode(@file_get_contents($dir . '/head.json'), true);
+    if (is_array($head)) return $head;
+    return ['segment' => 1, 'first_id' => 1, 'count' => 0, 'bytes' => 0, 'first_ts' => null, 'last_ts' => null];
+}
+
+function segWriteJson($path, $data) {
+    $tmp = $path . '.' . getmypid() . '.tmp';
+    if (file_put_contents($tmp, json_encode($data)) === false) return false;
+    return rename($tmp, $path);
+}
+
+/**
+ * Append a record; returns its location or false
+ */
+function segAppend($dir, $record, $hooks = []) {
+    $lock = @fopen($dir . '/.lock', 'c');
+    if (!$lock) {
+        @mkdir($dir, 0750, true);
+        $lock = @fopen($dir . '/.lock', 'c');
+        if (!$lock) return false;
+    }
+    if (!storeLock($lock, LOCK_EX)) {
+        fclose($lock);
+        return false;
+    }
+
+    $head = segLoadHead($dir);
+    $id = $head['first_id'] + $head['count'];
+    $line = frameRecord(json_encode(['id' => $id] + $record), "\t");
+    $offset = $head['bytes'];
+    $path = segPath($dir, $head['segment']);
+
+    // Drop bytes past the committed length (an append that died before head.json was updated)
+    clearstatcache(true, $path);
+    if (file_exists($path) && filesize($path) > $offset) {
+        $fp = fopen($path, 'r+');
+        ftruncate($fp, $offset);
+        fclose($fp);
+    }
+
+    // A short write is cut off by the truncation above on the next append
+    $fp = @fopen($path, 'ab');
+    $written = $fp && storeWrite($fp, $line);
+    if ($fp) fclose($fp);
+    if (!$written) {
+        flock($lock, LOCK_UN);
+        fclose($lock);
+        return false;
+    }
+
+    $head['count']++;
+    $head['bytes'] += strlen($line);
+    $head['first_ts'] = $head['first_ts'] ?? ($record['timestamp'] ?? null);
+    $head['last_ts'] = $record['timestamp'] ?? $head['last_ts'];
+    $location = ['id' => $id, 'segment' => $head['segment'], 'offset' => $offset, 'length' => strlen($line)];
+
+    if (isset($hooks['append'])) {
+        $hooks['append']($dir, ['id' => $id] + $record, $location);
+    }
+
+    if ($head['count'] >= SEG_RECORDS) {
+        $sealed = $head + ['sealed' => true];
+        if (isset($hooks['seal'])) {
+            $hooks['seal']($dir, $sealed);
+        }
+        $manifest = segLoadManifest($dir);
+        $manifest['segments'][] = $sealed;
+        segWriteJson($dir . '/manifest.json', $manifest);
+
+        $head = [
+            'segment' => $head['segment'] + 1,
+            'first_id' => $id + 1,
+            'count' => 0,
+            'bytes' => 0,
+            'first_ts' => null,
+            'last_ts' => null
+        ];
+    }
+    segWriteJson($dir . '/head.json', $head);
+
+    flock($lock, LOCK_UN);
+    fclose($lock);
+    return $location;
+}
+
+/**
+ * Sealed segments followed by the active one, oldest first
+ */
+function segList($dir) {
+    $segments = segLoadManifest($dir)['segments'];
+    $head = segLoadHead($dir);
+    if ($head['count'] > 0) {
+        $segments[] = $head + ['sealed' => false];
+    }
+    return $segments;
+}
+
+/**
+ * Read the record starting at a byte offset of a segment
+ */
+function segReadAt($dir, $segment, $offset) {
+    $fp = @fopen(segPath($dir, $segment), 'rb');
+    if (!$fp) return null;
+    fseek($fp, $offset);
+    $line = fgets($fp);
+    fclose($fp);
+    $payload = $line === false ? null : unframeRecord($line, "\t");
+    return $payload === null ? null : json_decode($payload, true);
+}
+
+/**
+ * Call $fn($record, $offset) for every committed record of a segment from $start
+ * $bytes bounds the scan to what head/manifest says is committed
+ */
+function segScan($dir, $segment, $bytes, $fn, $start = 0) {
+    $fp = @fopen(segPath($dir, $segment), 'rb');
+    if (!$fp) return;
+    fseek($fp, $start);
+    $pos = $start;
+    while ($pos < $bytes && ($line = fgets($fp)) !== false) {
+        $payload = unframeRecord($line, "\t");
+        $record = $payload === null ? null : json_decode($payload, true);
+        if (is_array($record)) {
+            if ($fn($record, $pos) === false) break;
+        }
+        $pos += strlen($line);
+    }
+    fclose($fp);
+}
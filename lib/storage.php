@@ -0,0 +1,129 @@
+<?php
+/**
+ * Storage primitives with bounded lock waits and optional fault injection
+ * Request-path writes go through storeAppend()/storeSync(), locks through
+ * storeLock(), which gives up after ZOLTARAN_LOCK_TIMEOUT_MS (default 2000)
+ * so a stalled lock holder turns into fast 503s instead of a pile of
+ * blocked PHP workers. A failed or short append is cut back to the record
+ * boundary while the lock is still held.
+ *
+ * Faults are off unless ZOLTARAN_FAULTS is set (used by bin/loadtest.php):
+ *   fsync_delay=MS     every storeSync() sleeps first
+ *   read_delay=MS      every storeRead() point sleeps first
+ *   enospc=P           a write fails with "No space left on device" with probability P
+ *   lock_stall=MS      an exclusive lock holder sleeps MS after acquiring
+ *   lock_stall_p=P     ... with probability P (default 1)
+ *   partial=P          a write stops halfway with probability P
+ * e.g. ZOLTARAN_FAULTS="fsync_delay=50,enospc=0.05"
+ */
+
+define('STORE_LOCK_POLL_US', 2000);
+
+function storeFaults() {
+    static $faults = null;
+    if ($faults === null) {
+        $faults = [];
+        foreach (array_filter(explode(',', (string)getenv('ZOLTARAN_FAULTS'))) as $pair) {
+            list($name, $value) = array_pad(explode('=', $pair, 2), 2, '1');
+            $faults[trim($name)] = (float)$value;
+        }
+    }
+    return $faults;
+}
+
+function storeFaultHit($name) {
+    $p = storeFaults()[$name] ?? 0;
+    return $p > 0 && mt_rand() / mt_getrandmax() < $p;
+}
+
+function storeFaultDelay($name) {
+    $ms = storeFaults()[$name] ?? 0;
+    if ($ms > 0) {
+        usleep((int)($ms * 1000));
+    }
+}
+
+function storeLockTimeout() {
+    return (int)(getenv('ZOLTARAN_LOCK_TIMEOUT_MS') ?: 2000);
+}
+
+/**
+ * flock() that waits at most the lock timeout; false when it gave up
+ */
+function storeLock($fp, $operation, $timeoutMs = null) {
+    $deadline = hrtime(true) + ($timeoutMs ?? storeLockTimeout()) * 1000000;
+    while (!flock($fp, $operation | LOCK_NB)) {
+        if (hrtime(true) >= $deadline) {
+            error_log('storage: lock wait timed out');
+            return false;
+        }
+        usleep(STORE_LOCK_POLL_US);
+    }
+    if ($operation === LOCK_EX && isset(storeFaults()['lock_stall'])
+        && (!isset(storeFaults()['lock_stall_p']) || storeFaultHit('lock_stall_p'))) {
+        storeFaultDelay('lock_stall');
+    }
+    return true;
+}
+
+/**
+ * fwrite() of the whole buffer; false on a failed or short write
+ */
+function storeWrite($fp, $data) {
+    if (storeFaultHit('enospc')) {
+        error_log('storage: write failed: No space left on device (injected)');
+        return false;
+    }
+    if (storeFaultHit('partial')) {
+        fwrite($fp, substr($data, 0, intdiv(strlen($data), 2)));
+        error_log('storage: short write (injected)');
+        return false;
+    }
+    return fwrite($fp, $data) === strlen($data);
+}
+
+function storeSync($fp) {
+    storeFaultDelay('fsync_delay');
+    fflush($fp);
+    return function_exists('fsync') ? fsync($fp) : true;
+}
+
+/**
+ * Marks a request-path read (for the read_delay fault)
+ */
+function storeRead() {
+    storeFaultDelay('read_delay');
+}
+
+/**
+ * Append whole records under an exclusive lock; returns bytes written or false
+ * Nothing of a failed append is left behind, so readers never see a torn line.
+ * A restore replaces the file by rename while holding its lock, so once the
+ * lock is ours the path must still name the file we opened; if not, reopen.
+ * $at is set to ['inode' => ..., 'offset' => ...] of the appended data.
+ */
+function storeAppend($file, $data, &$at = null) {
+    for ($attempt = 0; ; $attempt++) {
+        $fp = @fopen($file, 'ab');
+        if (!$fp) return false;
+        if (!storeLock($fp, LOCK_EX)) {
+            fclose($fp);
+            return false;
+        }
+        clearstatcache(true, $file);
+        if (fstat($fp)['ino'] === @fileinode($file) || $attempt >= 2) break;
+        flock($fp, LOCK_UN);
+        fclose($fp);
+    }
+    $stat = fstat($fp);
+    $size = $stat['size'];
+    $at = ['inode' => $stat['ino'], 'offset' => $size];
+    $ok = storeWrite($fp, $data);
+    if (!$ok) {
+        ftruncate($fp, $size);
+    }
+    fflush($fp);
+    flock($fp, LOCK_UN);
+    fclose($fp);
+    return $ok ? strlen($data) : false;
+}
@@ -0,0 +1,254 @@
+<?php
+/**
+ * Request velocity sketches for abuse detection
+ * Count-min sketches (VELOCITY_DEPTH rows x VELOCITY_WIDTH uint32 counters)
+ * over tumbling windows:
+ *   ip_requests        requests per IP                       (VELOCITY_IP_WINDOW)
+ *   ip_accounts        distinct accounts seen from an IP     (VELOCITY_IP_WINDOW)
+ *   ip_pairs           (IP, account) pairs, to tell new ones (VELOCITY_IP_WINDOW)
+ *   account_requests   requests per account                  (VELOCITY_ACCOUNT_WINDOW)
+ * A pair whose estimate is still 0 has definitely not been seen, so only then
+ * does ip_accounts count it; collisions can only make that undercount.
+ * Estimates never undercount requests. An update or query touches
+ * VELOCITY_DEPTH counters per sketch, whatever the traffic.
+ *
+ * Counters live in shared memory: APCu (atomic increments, one entry per
+ * counter) when loaded, else a shmop segment per sketch (header: window epoch
+ * uint32 BE, then the counters; concurrent increments may be lost, which
+ * only lowers estimates), else files under private/index/velocity/ with the
+ * same layout. ZOLTARAN_VELOCITY=apcu|shmop|file forces a backend.
+ * IPs over the account threshold are appended to private/index/velocity.flags
+ * for the admin view.
+ * The address is REMOTE_ADDR; forwarding headers are only believed when the
+ * connection comes from a proxy listed in ZOLTARAN_TRUSTED_PROXIES
+ * (comma-separated addresses), since clients can send them freely.
+ */
+
+define('VELOCITY_DEPTH', 4);
+define('VELOCITY_WIDTH', 4096);
+define('VELOCITY_IP_WINDOW', 3600);
+define('VELOCITY_ACCOUNT_WINDOW', 60);
+define('VELOCITY_MAX_IP_ACCOUNTS', 5);       // distinct accounts per IP per window
+define('VELOCITY_MAX_ACCOUNT_REQUESTS', 30); // requests per account per window
+define('VELOCITY_SKETCHES', [
+    'ip_requests' => VELOCITY_IP_WINDOW,
+    'ip_accounts' => VELOCITY_IP_WINDOW,
+    'ip_pairs' => VELOCITY_IP_WINDOW,
+    'account_requests' => VELOCITY_ACCOUNT_WINDOW
+]);
+
+function velocityBackend() {
+    static $backend = null;
+    if ($backend === null) {
+        $backend = getenv('ZOLTARAN_VELOCITY') ?: null;
+        if ($backend === null) {
+            if (function_exists('apcu_enabled') && apcu_enabled()) {
+                $backend = 'apcu';
+            } elseif (function_exists('shmop_open')) {
+                $backend = 'shmop';
+            } else {
+                $backend = 'file';
+            }
+        }
+    }
+    return $backend;
+}
+
+/**
+ * Client address for the limiter: REMOTE_ADDR, or the address a trusted
+ * proxy forwarded (CF-Connecting-IP, else the nearest untrusted hop of
+ * X-Forwarded-For)
+ */
+function velocityClientIp() {
+    $remote = $_SERVER['REMOTE_ADDR'] ?? '';
+    $trusted = array_filter(array_map('trim', explode(',', (string)getenv('ZOLTARAN_TRUSTED_PROXIES'))), 'strlen');
+    if (!in_array($remote, $trusted, true)) {
+        return filter_var($remote, FILTER_VALIDATE_IP) ? $remote : 'unknown';
+    }
+    $forwarded = $_SERVER['HTTP_CF_CONNECTING_IP'] ?? '';
+    if (filter_var($forwarded, FILTER_VALIDATE_IP)) {
+        return $forwarded;
+    }
+    $hops = array_reverse(array_map('trim', explode(',', $_SERVER['HTTP_X_FORWARDED_FOR'] ?? '')));
+    foreach ($hops as $hop) {
+        if (!in_array($hop, $trusted, true)) {
+            return filter_var($hop, FILTER_VALIDATE_IP) ? $hop : 'unknown';
+        }
+    }
+    return filter_var($remote, FILTER_VALIDATE_IP) ? $remote : 'unknown';
+}
+
+/**
+ * Counter index of $key in each row
+ */
+function velocityColumns($key) {
+    $h = unpack('N4', md5($key, true));
+    $columns = [];
+    for ($row = 0; $row < VELOCITY_DEPTH; $row++) {
+        $columns[] = $h[$row + 1] & (VELOCITY_WIDTH - 1);
+    }
+    return $columns;
+}
+
+/**
+ * Segment or file handle for a sketch, reset when its window has rolled over
+ */
+function velocityStore($dir, $sketch) {
+    static $stores = [];
+    $epoch = intdiv(time(), VELOCITY_SKETCHES[$sketch]);
+    $bytes = 4 + VELOCITY_DEPTH * VELOCITY_WIDTH * 4;
+    if (!isset($stores[$sketch])) {
+        if (velocityBackend() === 'shmop') {
+            $index = array_search($sketch, array_keys(VELOCITY_SKETCHES), true);
+            $handle = @shmop_open(ftok($dir, chr(ord('a') + $index)), 'c', 0600, $bytes);
+        } else {
+            $path = $dir . '/velocity/' . $sketch . '.cms';
+            $handle = @fopen($path, 'c+b');
+            if (!$handle) {
+                @mkdir(dirname($path), 0750, true);
+                $handle = @fopen($path, 'c+b');
+            }
+        }
+        if (!$handle) return null;
+        $stores[$sketch] = $handle;
+    }
+    $handle = $stores[$sketch];
+
+    $header = velocityReadAt($handle, 0, 4);
+    if (strlen($header) < 4 || unpack('N', $header)[1] !== $epoch) {
+        velocityWriteAt($handle, 0, pack('N', $epoch) . str_repeat("\0", $bytes - 4));
+    }
+    return $handle;
+}
+
+function velocityReadAt($handle, $offset, $length) {
+    if (velocityBackend() === 'shmop') {
+        return shmop_read($handle, $offset, $length);
+    }
+    fseek($handle, $offset);
+    return (string)fread($handle, $length);
+}
+
+function velocityWriteAt($handle, $offset, $data) {
+    if (velocityBackend() === 'shmop') {
+        shmop_write($handle, $data, $offset);
+        return;
+    }
+    fseek($handle, $offset);
+    fwrite($handle, $data);
+}
+
+/**
+ * Add $count to $key; returns the estimate before the update
+ */
+function velocityAdd($dir, $sketch, $key, $count = 1) {
+    $columns = velocityColumns($key);
+    $before = PHP_INT_MAX;
+    if (velocityBackend() === 'apcu') {
+        $epoch = intdiv(time(), VELOCITY_SKETCHES[$sketch]);
+        foreach ($columns as $row => $column) {
+            $value = apcu_inc("zv:$sketch:$epoch:$row:$column", $count, $ok, 2 * VELOCITY_SKETCHES[$sketch]);
+            $before = min($before, $ok ? $value - $count : 0);
+        }
+        return $before;
+    }
+
+    $handle = velocityStore($dir, $sketch);
+    if (!$handle) return 0;
+    foreach ($columns as $row => $column) {
+        $offset = 4 + ($row * VELOCITY_WIDTH + $column) * 4;
+        $raw = velocityReadAt($handle, $offset, 4);
+        $value = strlen($raw) === 4 ? unpack('N', $raw)[1] : 0;
+        $before = min($before, $value);
+        velocityWriteAt($handle, $offset, pack('N', $value + $count));
+    }
+    return $before;
+}
+
+/**
+ * Current estimate for $key (never below the true count, modulo lost shmop updates)
+ */
+function velocityEstimate($dir, $sketch, $key) {
+    $columns = velocityColumns($key);
+    $estimate = PHP_INT_MAX;
+    if (velocityBackend() === 'apcu') {
+        $epoch = intdiv(time(), VELOCITY_SKETCHES[$sketch]);
+        foreach ($columns as $row => $column) {
+            $estimate = min($estimate, (int)apcu_fetch("zv:$sketch:$epoch:$row:$column"));
+        }
+        return $estimate;
+    }
+
+    $handle = velocityStore($dir, $sketch);
+    if (!$handle) return 0;
+    foreach ($columns as $row => $column) {
+        $raw = velocityReadAt($handle, 4 + ($row * VELOCITY_WIDTH + $column) * 4, 4);
+        $estimate = min($estimate, strlen($raw) === 4 ? unpack('N', $raw)[1] : 0);
+    }
+    return $estimate;
+}
+
+/**
+ * Count one request of $account from $ip; returns the updated estimates
+ * With $countRequest false only the (IP, account) pairing is noted, for
+ * requests that follow an already counted one.
+ */
+function velocityRecord($dir, $ip, $account, $countRequest = true) {
+    if ($ip === 'unknown') {
+        return ['ip_requests' => 0, 'ip_accounts' => 0,
+            'account_requests' => $countRequest ? velocityAdd($dir, 'account_requests', $account) + 1 : 0];
+    }
+    $ipAccounts = velocityEstimate($dir, 'ip_accounts', $ip);
+    if (velocityAdd($dir, 'ip_pairs', $ip . '|' . $account) === 0) {
+        $ipAccounts = velocityAdd($dir, 'ip_accounts', $ip) + 1;
+        if ($ipAccounts === VELOCITY_MAX_IP_ACCOUNTS + 1) {
+            @file_put_contents($dir . '/velocity.flags', json_encode([
+                'time' => date('c'), 'ip' => $ip, 'account' => $account, 'accounts' => $ipAccounts
+            ]) . "\n", FILE_APPEND | LOCK_EX);
+        }
+    }
+    if (!$countRequest) {
+        return ['ip_requests' => 0, 'ip_accounts' => $ipAccounts, 'account_requests' => 0];
+    }
+    return [
+        'ip_requests' => velocityAdd($dir, 'ip_requests', $ip) + 1,
+        'ip_accounts' => $ipAccounts,
+        'account_requests' => velocityAdd($dir, 'account_requests', $account) + 1
+    ];
+}
+
+/**
+ * Rate limiter check on recorded estimates; null when within limits
+ */
+function velocityLimit($estimates) {
+    if ($estimates['ip_accounts'] > VELOCITY_MAX_IP_ACCOUNTS) {
+        return ['error' => 'Too many accounts from this address', 'retry_after' => VELOCITY_IP_WINDOW - time() % VELOCITY_IP_WINDOW];
+    }
+    if ($estimates['account_requests'] > VELOCITY_MAX_ACCOUNT_REQUESTS) {
+        return ['error' => 'Too many requests', 'retry_after' => VELOCITY_ACCOUNT_WINDOW - time() % VELOCITY_ACCOUNT_WINDOW];
+    }
+    return null;
+}
+
+/**
+ * Admin view: point estimates for an IP and/or account, plus the latest flagged IPs
+ */
+function velocityReport($dir, $ip, $account, $flagLimit = 50) {
+    $report = ['backend' => velocityBackend(), 'limits' => [
+        'ip_accounts' => VELOCITY_MAX_IP_ACCOUNTS, 'ip_window' => VELOCITY_IP_WINDOW,
+        'account_requests' => VELOCITY_MAX_ACCOUNT_REQUESTS, 'account_window' => VELOCITY_ACCOUNT_WINDOW
+    ]];
+    if ($ip !== '') {
+        $report['ip'] = [
+            'ip' => $ip,
+            'requests' => velocityEstimate($dir, 'ip_requests', $ip),
+            'accounts' => velocityEstimate($dir, 'ip_accounts', $ip)
+        ];
+    }
+    if ($account !== '') {
+        $report['account'] = ['account' => $account, 'requests' => velocityEstimate($dir, 'account_requests', $account)];
+    }
+    $flags = @file($dir . '/velocity.flags', FILE_IGNORE_NEW_LINES | FILE_SKIP_EMPTY_LINES) ?: [];
+    $report['flagged'] = array_map(function($line) { return json_decode($line, true); }, array_slice($flags, -$flagLimit));
+    return $report;
+}
@@ -0,0 +1,116 @@
+<?php
+/**
+ * Response encoding for the read actions
+ * Clients that send "Accept: application/msgpack" get MessagePack instead of
+ * JSON when the msgpack extension is loaded; without it they get JSON, which
+ * json_encode produces faster than any userland encoder could. Read
+ * actions also take fields=, a comma list of dotted paths that keeps only
+ * those keys; lists are walked through, so
+ *   ?action=get_leaderboard&fields=leaderboard.user,leaderboard.wins
+ * returns the user and wins of each entry and drops everything else.
+ * "success" and "error" are always kept.
+ */
+
+define('WIRE_MSGPACK_TYPES', ['application/msgpack', 'application/x-msgpack', 'application/vnd.msgpack']);
+
+/**
+ * Media ranges of an Accept header as type => q (the highest q when a type repeats)
+ */
+function wireAcceptRanges($accept) {
+    $ranges = [];
+    foreach (explode(',', strtolower($accept)) as $range) {
+        $params = array_map('trim', explode(';', $range));
+        $type = array_shift($params);
+        if ($type === '') continue;
+        $q = 1.0;
+        foreach ($params as $param) {
+            if (strncmp($param, 'q=', 2) === 0) {
+                $q = max(0.0, min(1.0, (float)substr($param, 2)));
+            }
+        }
+        $ranges[$type] = max($ranges[$type] ?? 0.0, $q);
+    }
+    return $ranges;
+}
+
+/**
+ * Whether the client prefers MessagePack: a msgpack type with q > 0 that
+ * outranks JSON (application/json, else application/*, else * / *)
+ */
+function wireWantsMsgpack() {
+    $ranges = wireAcceptRanges($_SERVER['HTTP_ACCEPT'] ?? '');
+    $msgpack = 0.0;
+    foreach (WIRE_MSGPACK_TYPES as $type) {
+        $msgpack = max($msgpack, $ranges[$type] ?? 0.0);
+    }
+    $json = $ranges['application/json'] ?? $ranges['application/*'] ?? $ranges['*/*'] ?? 0.0;
+    return $msgpack > 0 && $msgpack > $json;
+}
+
+/**
+ * fields= as the entry points read their action: JSON body, then query string, then form body
+ */
+function wireFields() {
+    $input = $_SERVER['REQUEST_METHOD'] === 'POST' ? json_decode(file_get_contents('php://input'), true) : null;
+    return (string)($input['fields'] ?? $_GET['fields'] ?? $_POST['fields'] ?? '');
+}
+
+/**
+ * Path tree from "a.b,a.c,d" => ['a' => ['b' => true, 'c' => true], 'd' => true]
+ */
+function wireFieldTree($fields) {
+    $tree = [];
+    foreach (explode(',', $fields) as $path) {
+        $parts = array_values(array_filter(explode('.', trim($path)), 'strlen'));
+        $node = &$tree;
+        foreach ($parts as $i => $part) {
+            if ($i === count($parts) - 1) {
+                $node[$part] = true; // a whole key wins over any of its sub-paths
+                break;
+            }
+            if (($node[$part] ?? null) === true) break;
+            $node[$part] = $node[$part] ?? [];
+            $node = &$node[$part];
+        }
+        unset($node);
+    }
+    return $tree;
+}
+
+function wireIsList($value) {
+    return $value === [] || array_keys($value) === range(0, count($value) - 1);
+}
+
+function wireSelect($value, $tree) {
+    if ($tree === true || !is_array($value)) {
+        return $value;
+    }
+    if (wireIsList($value)) {
+        return array_map(function($item) use ($tree) { return wireSelect($item, $tree); }, $value);
+    }
+    $out = [];
+    foreach ($tree as $key => $sub) {
+        if (array_key_exists($key, $value)) {
+            $out[$key] = wireSelect($value[$key], $sub);
+        }
+    }
+    return $out;
+}
+
+/**
+ * Send a read response in the negotiated format, restricted to ?fields=
+ */
+function wireRespond($data) {
+    $fields = wireFields();
+    if ($fields !== '') {
+        $tree = wireFieldTree($fields) + ['success' => true, 'error' => true];
+        $data = wireSelect($data, $tree);
+    }
+    header('Vary: Accept');
+    if (function_exists('msgpack_pack') && wireWantsMsgpack()) {
+        header('Content-Type: application/msgpack');
+        echo msgpack_pack($data);
+        return;
+    }
+    echo json_encode($data);
+}
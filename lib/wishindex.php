@@ -0,0 +1,292 @@
+<?php
+/**
+ * Inverted index over private wish text for moderation search
+ * Each sealed segment gets seg-NNNNNN.inv:
+ *   {"first_id": n, "count": n, "terms": {token: postings}, "offsets": packed,
+ *    "times": [[timestamp, offset], ...]}
+ * Postings are record ids as varint deltas from first_id - 1 (base64), terms
+ * are sorted so prefix queries are a binary search, "offsets" maps every
+ * record of the segment to its byte offset (WISH_NO_OFFSET for a record that
+ * does not decode, so later ones stay in place) and "times" samples every
+ * WISH_TIME_SAMPLE-th record for time-range seeks. The active segment is
+ * bounded by SEG_RECORDS and is searched by scanning it.
+ */
+
+define('WISH_SEARCH_MAX_LIMIT', 200);
+define('WISH_TIME_SAMPLE', 64);
+define('WISH_NO_OFFSET', 0xFFFFFFFF);
+
+/**
+ * Normalized search tokens of a wish (unique, at least 2 characters)
+ */
+function wishTokens($text) {
+    $tokens = preg_split('/[^a-z0-9]+/', strtolower($text), -1, PREG_SPLIT_NO_EMPTY);
+    $tokens = array_filter($tokens, function($t) { return strlen($t) >= 2; });
+    return array_values(array_unique($tokens));
+}
+
+function varintEncodeDeltas($ids, $base) {
+    $out = '';
+    $prev = $base;
+    foreach ($ids as $id) {
+        $delta = $id - $prev;
+        $prev = $id;
+        while ($delta >= 0x80) {
+            $out .= chr(($delta & 0x7f) | 0x80);
+            $delta >>= 7;
+        }
+        $out .= chr($delta);
+    }
+    return base64_encode($out);
+}
+
+/**
+ * Decode postings into an id => true set
+ */
+function varintDecodeDeltas($blob, $base) {
+    $bytes = base64_decode($blob);
+    $ids = [];
+    $prev = $base;
+    $value = 0;
+    $shift = 0;
+    for ($i = 0, $n = strlen($bytes); $i < $n; $i++) {
+        $b = ord($bytes[$i]);
+        $value |= ($b & 0x7f) << $shift;
+        if ($b & 0x80) {
+            $shift += 7;
+            continue;
+        }
+        $prev += $value;
+        $ids[$prev] = true;
+        $value = 0;
+        $shift = 0;
+    }
+    return $ids;
+}
+
+/**
+ * Build the index file for a sealed segment (bin/wishindex.php, or a segAppend
+ * seal hook in offline imports)
+ */
+function wishBuildIndex($dir, $segment) {
+    $postings = [];
+    // Slots are placed by record id: segScan() skips records that fail to decode
+    $offsets = array_fill(0, $segment['count'], WISH_NO_OFFSET);
+    $times = [];
+    segScan($dir, $segment['segment'], $segment['bytes'], function($record, $offset) use (&$postings, &$offsets, &$times, $segment) {
+        $slot = (int)($record['id'] ?? 0) - $segment['first_id'];
+        if ($slot < 0 || $slot >= $segment['count']) return;
+        if ($slot % WISH_TIME_SAMPLE === 0) {
+            $times[] = [$record['timestamp'] ?? '', $offset];
+        }
+        $offsets[$slot] = $offset;
+        foreach (wishTokens($record['wish'] ?? '') as $token) {
+            $postings[$token][] = $record['id'];
+        }
+    });
+
+    ksort($postings, SORT_STRING);
+    $terms = [];
+    foreach ($postings as $token => $ids) {
+        $terms[(string)$token] = varintEncodeDeltas($ids, $segment['first_id'] - 1);
+    }
+
+    return segWriteJson(segPath($dir, $segment['segment'], 'inv'), [
+        'first_id' => $segment['first_id'],
+        'count' => $segment['count'],
+        'terms' => (object)$terms,
+        'offsets' => base64_encode(pack('N*', ...$offsets)),
+        'times' => $times
+    ]);
+}
+
+function wishLoadIndex($dir, $segment) {
+    $index = @json_decode(@file_get_contents(segPath($dir, $segment, 'inv')), true);
+    if (!is_array($index)) return null;
+    $index['keys'] = array_map('strval', array_keys($index['terms']));
+    return $index;
+}
+
+/**
+ * Parse "a b OR c* -d" into OR-ed clauses of required, prefix and excluded terms
+ */
+function wishParseQuery($query) {
+    $clauses = [];
+    $clause = ['all' => [], 'prefix' => [], 'not' => []];
+    foreach (preg_split('/\s+/', trim($query), -1, PREG_SPLIT_NO_EMPTY) as $word) {
+        if ($word === 'OR') {
+            $clauses[] = $clause;
+            $clause = ['all' => [], 'prefix' => [], 'not' => []];
+            continue;
+        }
+        $negate = $word[0] === '-';
+        $isPrefix = substr($word, -1) === '*';
+        $term = strtolower(preg_replace('/[^A-Za-z0-9]/', '', $word));
+        if ($term === '') continue;
+
+        if ($negate) {
+            $clause['not'][] = $term;
+        } elseif ($isPrefix) {
+            $clause['prefix'][] = $term;
+        } else {
+            $clause['all'][] = $term;
+        }
+    }
+    $clauses[] = $clause;
+
+    // A clause needs at least one positive term to select anything
+    return array_values(array_filter($clauses, function($c) {
+        return $c['all'] || $c['prefix'];
+    }));
+}
+
+/**
+ * Ids of a sealed segment whose token set contains any term starting with $prefix
+ */
+function wishPrefixPostings($index, $prefix) {
+    $keys = $index['keys'];
+    $lo = 0;
+    $hi = count($keys);
+    while ($lo < $hi) {
+        $mid = ($lo + $hi) >> 1;
+        if (strcmp($keys[$mid], $prefix) < 0) {
+            $lo = $mid + 1;
+        } else {
+            $hi = $mid;
+        }
+    }
+    $ids = [];
+    for ($i = $lo; $i < count($keys) && strncmp($keys[$i], $prefix, strlen($prefix)) === 0; $i++) {
+        $ids += varintDecodeDeltas($index['terms'][$keys[$i]], $index['first_id'] - 1);
+    }
+    return $ids;
+}
+
+function wishTermPostings($index, $term) {
+    if (!isset($index['terms'][$term])) return [];
+    return varintDecodeDeltas($index['terms'][$term], $index['first_id'] - 1);
+}
+
+/**
+ * Matching ids of a sealed segment (id => true)
+ */
+function wishMatchIndex($index, $clauses) {
+    $matches = [];
+    foreach ($clauses as $clause) {
+        $sets = [];
+        foreach ($clause['all'] as $term) {
+            $sets[] = wishTermPostings($index, $term);
+        }
+        foreach ($clause['prefix'] as $prefix) {
+            $sets[] = wishPrefixPostings($index, $prefix);
+        }
+        usort($sets, function($a, $b) { return count($a) - count($b); });
+
+        $ids = array_shift($sets);
+        foreach ($sets as $set) {
+            if (!$ids) break;
+            $ids = array_intersect_key($ids, $set);
+        }
+        foreach ($clause['not'] as $term) {
+            if (!$ids) break;
+            $ids = array_diff_key($ids, wishTermPostings($index, $term));
+        }
+        $matches += $ids;
+    }
+    return $matches;
+}
+
+/**
+ * Whether one record's token list satisfies the query (active segment scan)
+ */
+function wishMatchRecord($tokens, $clauses) {
+    $set = array_flip($tokens);
+    foreach ($clauses as $clause) {
+        $ok = true;
+        foreach ($clause['all'] as $term) {
+            if (!isset($set[$term])) { $ok = false; break; }
+        }
+        foreach ($clause['prefix'] as $prefix) {
+            if (!$ok) break;
+            $found = false;
+            foreach ($tokens as $token) {
+                if (strncmp($token, $prefix, strlen($prefix)) === 0) { $found = true; break; }
+            }
+            $ok = $found;
+        }
+        foreach ($clause['not'] as $term) {
+            if ($ok && isset($set[$term])) $ok = false;
+        }
+        if ($ok) return true;
+    }
+    return false;
+}
+
+/**
+ * Newest-first page of records matching $query with id < $beforeId
+ * Returns ['records' => [...], 'next_before' => id|null]
+ */
+function wishSearch($dir, $query, $limit, $beforeId = null) {
+    $clauses = wishParseQuery($query);
+    $records = [];
+    if (!$clauses) return ['records' => [], 'next_before' => null];
+
+    foreach (array_reverse(segList($dir)) as $segment) {
+        if ($beforeId !== null && $segment['first_id'] >= $beforeId) continue;
+        $need = $limit + 1 - count($records);
+        if ($need <= 0) break;
+
+        // The active segment, and sealed ones bin/wishindex.php has not indexed yet, are scanned
+        $index = $segment['sealed'] ? wishLoadIndex($dir, $segment['segment']) : null;
+        if ($index === null) {
+            $hits = [];
+            segScan($dir, $segment['segment'], $segment['bytes'], function($record) use (&$hits, $clauses, $beforeId) {
+                if ($beforeId !== null && $record['id'] >= $beforeId) return false;
+                if (wishMatchRecord(wishTokens($record['wish'] ?? ''), $clauses)) {
+                    $hits[] = $record;
+                }
+            });
+            foreach (array_slice(array_reverse($hits), 0, $need) as $record) {
+                $records[] = $record;
+            }
+            continue;
+        }
+
+        $ids = array_keys(wishMatchIndex($index, $clauses));
+        rsort($ids);
+
+        $offsets = unpack('N*', base64_decode($index['offsets']));
+        foreach ($ids as $id) {
+            if ($beforeId !== null && $id >= $beforeId) continue;
+            if ($need <= 0) break;
+            $offset = $offsets[$id - $index['first_id'] + 1] ?? WISH_NO_OFFSET;
+            if ($offset === WISH_NO_OFFSET) continue;
+            $record = segReadAt($dir, $segment['segment'], $offset);
+            // Indexes built before slots were placed by id may be shifted; never return another wish
+            if ($record !== null && ($record['id'] ?? null) === $id) {
+                $records[] = $record;
+                $need--;
+            }
+        }
+    }
+
+    $next = null;
+    if (count($records) > $limit) {
+        $records = array_slice($records, 0, $limit);
+        $next = end($records)['id'];
+    }
+    return ['records' => $records, 'next_before' => $next];
+}
+
+/**
+ * Opaque page cursors (URL-safe base64 of the cursor state)
+ */
+function wishEncodeCursor($data) {
+    return $data === null ? null : rtrim(strtr(base64_encode(json_encode($data)), '+/', '-_'), '=');
+}
+
+function wishDecodeCursor($cursor) {
+    if (!$cursor) return null;
+    $data = json_decode(base64_decode(strtr($cursor, '-_', '+/')), true);
+    return is_array($data) ? $data : null;
+}
@@ -0,0 +1,174 @@
+<?php
+/**
+ * Secondary indexes over the private wish store for admin history queries
+ *   by_user/<shard>/<account>.lst  account -> record locations
+ *   by_ip/<shard>/<packed ip>.lst  IP (inet_pton, hex) -> record locations
+ * Posting files are appended under the store's append lock with fixed
+ * WISH_POSTING_SIZE entries (id, segment, offset), so a newest-first page is a
+ * single read of limit * 12 bytes from the end. Time queries locate the first
+ * segment through the manifest time ranges and seek inside it with the
+ * sampled timestamps of its .inv file. Timestamps are date('c') strings with
+ * the server's UTC offset, so they are compared as instants, not as text.
+ */
+
+define('WISH_POSTING_SIZE', 12);
+
+/**
+ * Hex of the packed binary address, or null for unparseable IPs
+ */
+function wishPackIp($ip) {
+    $packed = @inet_pton($ip);
+    return $packed === false ? null : bin2hex($packed);
+}
+
+/**
+ * Unix time of a stored timestamp (0 for missing or unparseable ones)
+ */
+function wishTime($timestamp) {
+    $time = $timestamp === null || $timestamp === '' ? false : strtotime($timestamp);
+    return $time === false ? 0 : $time;
+}
+
+/**
+ * Whether a record belongs to a posting list key
+ */
+function wishPostingMatches($kind, $key, $record) {
+    if ($kind === 'user') {
+        return ($record['user'] ?? null) === $key;
+    }
+    return wishPackIp($record['ip'] ?? '') === $key;
+}
+
+function wishPostingPath($dir, $kind, $key) {
+    return sprintf('%s/by_%s/%s/%s.lst', $dir, $kind, substr(md5($key), 0, 2), $key);
+}
+
+function wishAppendPosting($path, $location) {
+    $entry = pack('NNN', $location['id'], $location['segment'], $location['offset']);
+    if (@file_put_contents($path, $entry, FILE_APPEND) === false) {
+        @mkdir(dirname($path), 0750, true);
+        file_put_contents($path, $entry, FILE_APPEND);
+    }
+}
+
+/**
+ * segAppend 'append' hook: add the record to its account and IP lists
+ */
+function wishIndexRecord($dir, $record, $location) {
+    if (!empty($record['user'])) {
+        wishAppendPosting(wishPostingPath($dir, 'user', $record['user']), $location);
+    }
+    $ip = wishPackIp($record['ip'] ?? '');
+    if ($ip !== null) {
+        wishAppendPosting(wishPostingPath($dir, 'ip', $ip), $location);
+    }
+}
+
+/**
+ * Newest-first page from a posting list; $before is an entry position
+ * Returns ['records' => [...], 'next' => position|null]
+ */
+function wishPostingPage($dir, $kind, $key, $limit, $before = null) {
+    $map = mmapOpen(wishPostingPath($dir, $kind, $key));
+    if (!$map) return ['records' => [], 'next' => null];
+
+    $entries = intdiv($map['size'], WISH_POSTING_SIZE);
+    $end = $before === null ? $entries : min($before, $entries);
+    $start = max(0, $end - $limit);
+
+    $records = [];
+    if ($end > $start) {
+        $raw = mmapRead($map, $start * WISH_POSTING_SIZE, ($end - $start) * WISH_POSTING_SIZE);
+        for ($i = strlen($raw) - WISH_POSTING_SIZE; $i >= 0; $i -= WISH_POSTING_SIZE) {
+            $p = unpack('Nid/Nsegment/Noffset', substr($raw, $i, WISH_POSTING_SIZE));
+            $record = segReadAt($dir, $p['segment'], $p['offset']);
+            // Segments dropped by retention leave stale entries behind until the list is compacted,
+            // and an append that died before head.json was written leaves one whose id and
+            // offset the next record reuses; the key check keeps another account's record out
+            if ($record !== null && $record['id'] === $p['id'] && wishPostingMatches($kind, $key, $record)) {
+                $records[] = $record;
+            }
+        }
+    }
+
+    return ['records' => $records, 'next' => $start > 0 ? $start : null];
+}
+
+/**
+ * Index in $segments of the first segment that may hold records at or after $from
+ */
+function wishFirstSegmentFrom($segments, $from) {
+    $from = wishTime($from);
+    $lo = 0;
+    $hi = count($segments);
+    while ($lo < $hi) {
+        $mid = ($lo + $hi) >> 1;
+        if (wishTime($segments[$mid]['last_ts'] ?? null) < $from) {
+            $lo = $mid + 1;
+        } else {
+            $hi = $mid;
+        }
+    }
+    return $lo;
+}
+
+/**
+ * Byte offset inside a sealed segment to start scanning for $from
+ */
+function wishSeekTime($dir, $segment, $from) {
+    if (!$segment['sealed']) return 0;
+    $index = wishLoadIndex($dir, $segment['segment']);
+    $from = wishTime($from);
+    $offset = 0;
+    foreach ($index['times'] ?? [] as $sample) {
+        if (wishTime($sample[0]) >= $from) break;
+        $offset = $sample[1];
+    }
+    return $offset;
+}
+
+/**
+ * Oldest-first page of records with $from <= timestamp <= $to
+ * $cursor is [segment, offset] from a previous page
+ */
+function wishTimePage($dir, $from, $to, $limit, $cursor = null) {
+    $segments = segList($dir);
+    $records = [];
+    $next = null;
+
+    if ($cursor !== null) {
+        $i = 0;
+        while ($i < count($segments) && $segments[$i]['segment'] < $cursor[0]) $i++;
+        $offset = ($segments[$i]['segment'] ?? null) === $cursor[0] ? $cursor[1] : 0;
+    } else {
+        $i = wishFirstSegmentFrom($segments, $from);
+        $offset = $i < count($segments) ? wishSeekTime($dir, $segments[$i], $from) : 0;
+    }
+
+    $fromTime = wishTime($from);
+    $toTime = wishTime($to);
+    $done = false;
+    for (; $i < count($segments) && !$done; $i++) {
+        $segment = $segments[$i];
+        if (wishTime($segment['first_ts'] ?? null) > $toTime) break;
+
+        segScan($dir, $segment['segment'], $segment['bytes'], function($record, $pos) use (&$records, &$next, &$done, $fromTime, $toTime, $limit, $segment) {
+            $ts = wishTime($record['timestamp'] ?? null);
+            if ($ts < $fromTime) return true;
+            if ($ts > $toTime) {
+                $done = true;
+                return false;
+            }
+            if (count($records) >= $limit) {
+                $next = [$segment['segment'], $pos];
+                $done = true;
+                return false;
+            }
+            $records[] = $record;
+            return true;
+        }, $offset);
+        $offset = 0;
+    }
+
+    return ['records' => $records, 'next' => $next];
+}
@@ -7,7 +7,7 @@
 header('Content-Type: application/json');
 header('Access-Control-Allow-Origin: *');
 header('Access-Control-Allow-Methods: GET, POST, OPTIONS');
-header('Access-Control-Allow-Headers: Content-Type');
+header('Access-Control-Allow-Headers: Content-Type, X-Admin-Token');
 
 // Handle preflight
 if ($_SERVER['REQUEST_METHOD'] === 'OPTIONS') {
@@ -15,38 +15,58 @@ if ($_SERVER['REQUEST_METHOD'] === 'OPTIONS') {
     exit();
 }
 
-// File paths
-$LOG_FILE = __DIR__ . '/log.txt';
-$PAYOUT_QUEUE_FILE = __DIR__ . '/payout_queue.txt';
-$PRIVATE_JSON_LOG = __DIR__ . '/private/wishes.json'; // Private JSON log
+require_once __DIR__ . '/lib/bootstrap.php';
 
-// Ensure directories and files exist
-if (!file_exists($LOG_FILE)) {
-    file_put_contents($LOG_FILE, "# Psychic Traveller Wish Game Log\n# Format: timestamp | user | result | tokens_won | memo\n# Wishes are stored privately\n\n");
-}
-if (!file_exists($PAYOUT_QUEUE_FILE)) {
-    file_put_contents($PAYOUT_QUEUE_FILE, "# Payout Queue\n# Format: timestamp | queue_id | recipient | amount | memo | status\n\n");
+// Get request data (GET requests have no body to read)
+$input = $_SERVER['REQUEST_METHOD'] === 'POST' ? json_decode(file_get_contents('php://input'), true) : null;
+$action = $input['action'] ?? $_GET['action'] ?? '';
+profilerStart($DATA_DIR . '/private/profile.json', $DATA_DIR . '/private/profiles', 'psychic_queue', (string)$action,
+    ['log_result', 'queue_payout', 'get_leaderboard', 'get_stats', 'get_recent', 'config_version', 'config',
+     'wallet_stats', 'analytics', 'search_wishes', 'query_wishes', 'active_players', 'metrics', 'velocity',
+     'export', 'replicate']);
+
+// Game partition (see lib/games.php); the default game keeps the original file layout
+$GAME = $input['game'] ?? $_GET['game'] ?? GAME_DEFAULT;
+if ($GAME !== GAME_DEFAULT && (!isValidGameType($GAME) || !in_array($GAME, gameTypes($DATA_DIR), true))) {
+    echo json_encode(['success' => false, 'error' => 'Unknown game']);
+    exit();
 }
+$paths = gamePaths($DATA_DIR, $GAME);
 
-// Create private directory with index.php protection
-$privateDir = __DIR__ . '/private';
-if (!is_dir($privateDir)) {
-    mkdir($privateDir, 0750, true); // chmod 750
-    // Create index.php to block directory listing/access
-    $indexContent = "<?php\nhttp_response_code(403);\ndie('403 Forbidden');\n";
-    file_put_contents($privateDir . '/index.php', $indexContent);
-}
-if (!file_exists($PRIVATE_JSON_LOG)) {
-    file_put_contents($PRIVATE_JSON_LOG, json_encode(['wishes' => []], JSON_PRETTY_PRINT));
+// File paths
+$LOG_FILE = $paths['log'];
+$PAYOUT_QUEUE_FILE = $paths['payout'];
+$WISH_STORE_DIR = $paths['wishes']; // Private wish log segments + search index
+$LOG_STATE_FILE = $paths['state']; // Derived log state checkpoint (bin/rebuild.php)
+$CUBE_DIR = $paths['cube']; // Hourly rollup cube
+$HLL_DIR = $paths['hll']; // Distinct-player sketches
+$ACCOUNTS_BLOOM = $paths['bloom']; // Accounts that ever played or bought credits
+$REPLICA_STATUS_FILE = $paths['replica']; // Last catch-up with the primary (replicas only)
+$FILTER_CONFIG = $DATA_DIR . '/private/filter.json'; // Optional wish filter patterns
+$GAME_CONFIG = $paths['config']; // Versioned pricing/outcome manifest shared with the client
+$DRIFT_FILE = $paths['drift']; // Outcome distribution monitor (lib/drift.php)
+$VELOCITY_DIR = $DATA_DIR . '/private/index'; // Request velocity sketches, shared by all games
+
+// Replicas serve public reads only, and only while close enough behind the primary
+if ($ROLE === 'replica') {
+    if (!in_array($action, ['get_leaderboard', 'get_stats', 'get_recent', 'wallet_stats', 'config', 'config_version'], true)) {
+        http_response_code(503);
+        echo json_encode(['success' => false, 'error' => 'Read-only replica']);
+        exit();
+    }
+    $lag = replLag($REPLICA_STATUS_FILE);
+    if ($lag === null || $lag > replMaxLag()) {
+        http_response_code(503);
+        header('Retry-After: 1');
+        echo json_encode(['success' => false, 'error' => 'Replica is behind the primary']);
+        exit();
+    }
+    header(sprintf('X-Replica-Lag: %.3f', $lag));
 }
 
-// Get request data
-$input = json_decode(file_get_contents('php://input'), true);
-$action = $input['action'] ?? $_GET['action'] ?? '';
-
 switch ($action) {
     case 'log_result':
-        logGameResult($input, $LOG_FILE, $PRIVATE_JSON_LOG);
+        logGameResult($input, $LOG_FILE, $WISH_STORE_DIR, $CUBE_DIR, $HLL_DIR, $ACCOUNTS_BLOOM, $FILTER_CONFIG, $GAME_CONFIG, $DRIFT_FILE, $VELOCITY_DIR);
         break;
 
     case 'queue_payout':
@@ -54,17 +74,78 @@ switch ($action) {
         break;
 
     case 'get_leaderboard':
-        getLeaderboard($LOG_FILE);
+        getLeaderboard($LOG_FILE, $LOG_STATE_FILE);
         break;
 
     case 'get_stats':
-        getStats($LOG_FILE, $input['user'] ?? '');
+        getStats($LOG_FILE, $LOG_STATE_FILE, $ACCOUNTS_BLOOM, $input['user'] ?? '');
         break;
 
     case 'get_recent':
         getRecentActivity($LOG_FILE);
         break;
 
+    case 'config_version':
+        getConfigVersion($GAME_CONFIG);
+        break;
+
+    case 'config':
+        getConfig($GAME_CONFIG, $_GET['v'] ?? null);
+        break;
+
+    case 'wallet_stats':
+        getWalletStats($DATA_DIR, $input['user'] ?? $_GET['user'] ?? '');
+        break;
+
+    case 'analytics':
+        if (requireAdmin($input)) {
+            getAnalytics($CUBE_DIR, $input ?? $_GET);
+        }
+        break;
+
+    case 'search_wishes':
+        if (requireAdmin($input)) {
+            searchWishes($WISH_STORE_DIR, $input ?? $_GET);
+        }
+        break;
+
+    case 'query_wishes':
+        if (requireAdmin($input)) {
+            queryWishes($WISH_STORE_DIR, $input ?? $_GET);
+        }
+        break;
+
+    case 'active_players':
+        if (requireAdmin($input)) {
+            getActivePlayers($HLL_DIR, $input ?? $_GET);
+        }
+        break;
+
+    case 'metrics':
+        if (requireAdmin($input)) {
+            echo json_encode(['success' => true, 'game' => $GAME, 'drift' => driftMetrics($DRIFT_FILE, gameConfig($GAME_CONFIG))]);
+        }
+        break;
+
+    case 'velocity':
+        if (requireAdmin($input)) {
+            $query = $input ?? $_GET;
+            echo json_encode(['success' => true] + velocityReport($VELOCITY_DIR, (string)($query['ip'] ?? ''), sanitizeAccount($query['user'] ?? '')));
+        }
+        break;
+
+    case 'export':
+        if (requireAdmin($input)) {
+            exportResults($LOG_FILE, $LOG_STATE_FILE, $WISH_STORE_DIR, $input ?? $_GET);
+        }
+        break;
+
+    case 'replicate':
+        if (requireAdmin($input)) {
+            replicateLog($LOG_FILE, $input ?? $_GET);
+        }
+        break;
+
     default:
         echo json_encode(['success' => false, 'error' => 'Invalid action']);
 }
@@ -92,20 +173,20 @@ function getClientIP() {
 /**
  * Log a game result
  */
-function logGameResult($data, $file, $jsonFile) {
+function logGameResult($data, $file, $wishDir, $cubeDir, $hllDir, $bloomFile, $filterConfig, $gameConfig, $driftFile, $velocityDir) {
     $user = sanitizeAccount($data['user'] ?? '');
     $result = strtoupper($data['result_code'] ?? 'UNKNOWN');
-    $tokens = intval($data['tokens_won'] ?? 0);
+    // Payouts for known outcomes come from the manifest, not from the client
+    $tokens = gameConfigPayout(gameConfig($gameConfig), $result) ?? intval($data['tokens_won'] ?? 0);
     $memo = preg_replace('/[^A-Za-z0-9_-]/', '', $data['memo'] ?? '');
-    $rawWish = $data['wish'] ?? '';
-    // Check for abusive patterns (scripts, SQL, code execution attempts)
-    $abusePatterns = '/<script|javascript:|on\w+\s*=|SELECT\s|INSERT\s|DELETE\s|DROP\s|UPDATE\s|UNION\s|eval\(|exec\(|system\(|\$\{|<\?|<%|\\\x/i';
-    if (preg_match($abusePatterns, $rawWish)) {
+    // Check for abusive patterns (scripts, SQL, code execution attempts) and keep only
+    // letters, numbers, spaces and basic punctuation, in one linear pass
+    $filtered = contentFilter(contentFilterLoad($filterConfig), (string)($data['wish'] ?? ''));
+    if ($filtered['blocked']) {
         echo json_encode(['success' => false, 'error' => 'try again']);
         return;
     }
-    // Allow letters, numbers, spaces, and basic punctuation for paragraphs
-    $wish = substr(preg_replace('/[^A-Za-z0-9 .,!?\'\"\n\r-]/', '', $rawWish), 0, 180);
+    $wish = $filtered['wish'];
     $ip = getClientIP();
     $userAgent = substr($_SERVER['HTTP_USER_AGENT'] ?? 'unknown', 0, 200);
 
@@ -114,6 +195,10 @@ function logGameResult($data, $file, $jsonFile) {
         return;
     }
 
+    // The wish was already charged and played by credits.php, which enforces the
+    // limits; refusing it here would only lose the result
+    velocityRecord($velocityDir, velocityClientIp(), $user, false);
+
     // Map result codes to readable names
     $resultMap = [
         'WISH_GRANTED' => 'WIN',
@@ -130,19 +215,33 @@ function logGameResult($data, $file, $jsonFile) {
 
     $timestamp = date('c');
 
-    // Public log (no IP, no wish - wishes only stored in private JSON)
-    $line = "$timestamp | $user | $displayResult | $tokens | $memo\n";
-
-    // Append to public log with exclusive lock
-    $success = file_put_contents($file, $line, FILE_APPEND | LOCK_EX);
+    // Public log (no IP, no wish - wishes only stored privately), framed with length and checksum
+    $line = frameRecord("$timestamp | $user | $displayResult | $tokens | $memo");
 
-    // Private JSON log (with IP for abuse monitoring)
-    $jsonData = [];
-    if (file_exists($jsonFile)) {
-        $jsonData = json_decode(file_get_contents($jsonFile), true) ?? ['wishes' => []];
+    // Mark the account as known before it becomes visible to readers; nothing is written yet, so a retry is safe
+    if (!bloomAdd($bloomFile, $user)) {
+        http_response_code(503);
+        header('Retry-After: 1');
+        echo json_encode(['success' => false, 'error' => 'Failed to write log']);
+        return;
     }
 
-    $jsonData['wishes'][] = [
+    // Append to public log with exclusive lock (bounded wait, no torn line on failure).
+    // Nothing else is written when it fails, so the 503 can be retried without duplicates.
+    if (storeAppend($file, $line, $logAt) === false) {
+        http_response_code(503);
+        header('Retry-After: 1');
+        echo json_encode(['success' => false, 'error' => 'Failed to write log']);
+        return;
+    }
+    cubeRecord($cubeDir, $timestamp, $displayResult, $tokens, $logAt);
+    hllRecord($hllDir, $user);
+    driftRecord($driftFile, gameConfig($gameConfig), $result);
+
+    // Private wish log (with IP for abuse monitoring); sealed segments are indexed by
+    // bin/wishindex.php pending, not under this request's append lock.
+    // The result is already public, so a failure here is reported but not retried.
+    $stored = segAppend($wishDir, [
         'timestamp' => $timestamp,
         'user' => $user,
         'result' => $displayResult,
@@ -152,28 +251,21 @@ function logGameResult($data, $file, $jsonFile) {
         'memo' => $memo,
         'ip' => $ip,
         'user_agent' => $userAgent
-    ];
-
-    // Keep only last 10000 entries to prevent file bloat
-    if (count($jsonData['wishes']) > 10000) {
-        $jsonData['wishes'] = array_slice($jsonData['wishes'], -10000);
+    ], ['append' => 'wishIndexRecord']);
+    if ($stored === false) {
+        error_log("psychic_queue: wish of $user at $timestamp not stored");
     }
 
-    file_put_contents($jsonFile, json_encode($jsonData, JSON_PRETTY_PRINT), LOCK_EX);
-
-    if ($success !== false) {
-        echo json_encode([
-            'success' => true,
-            'logged' => [
-                'user' => $user,
-                'result' => $displayResult,
-                'tokens' => $tokens,
-                'timestamp' => $timestamp
-            ]
-        ]);
-    } else {
-        echo json_encode(['success' => false, 'error' => 'Failed to write log']);
-    }
+    echo json_encode([
+        'success' => true,
+        'wish_stored' => $stored !== false,
+        'logged' => [
+            'user' => $user,
+            'result' => $displayResult,
+            'tokens' => $tokens,
+            'timestamp' => $timestamp
+        ]
+    ]);
 }
 
 /**
@@ -206,9 +298,9 @@ function queuePayout($data, $file) {
     $timestamp = date('c');
     $quantity = number_format($amount, 0) . ' ARCADE';
 
-    $line = "$timestamp | $queueId | $recipient | $quantity | $memo | PENDING\n";
+    $line = frameRecord("$timestamp | $queueId | $recipient | $quantity | $memo | PENDING");
 
-    $success = file_put_contents($file, $line, FILE_APPEND | LOCK_EX);
+    $success = storeAppend($file, $line);
 
     if ($success !== false) {
         echo json_encode([
@@ -219,6 +311,8 @@ function queuePayout($data, $file) {
             'memo' => $memo
         ]);
     } else {
+        http_response_code(503);
+        header('Retry-After: 1');
         echo json_encode(['success' => false, 'error' => 'Failed to queue payout']);
     }
 }
@@ -226,47 +320,24 @@ function queuePayout($data, $file) {
 /**
  * Get leaderboard (top 3 players)
  */
-function getLeaderboard($file) {
+function getLeaderboard($file, $stateFile) {
     $stats = [];
 
     if (!file_exists($file)) {
-        echo json_encode(['success' => true, 'leaderboard' => []]);
+        wireRespond(['success' => true, 'leaderboard' => []]);
         return;
     }
 
-    $lines = file($file, FILE_IGNORE_NEW_LINES | FILE_SKIP_EMPTY_LINES);
+    $state = logCurrentState($file, $stateFile);
 
-    foreach ($lines as $line) {
-        if (strpos($line, '#') === 0) continue;
-
-        $parts = array_map('trim', explode('|', $line));
-        if (count($parts) < 4) continue;
-
-        $user = $parts[1];
-        $result = $parts[2];
-        $tokens = intval($parts[3]);
-
-        if (!isset($stats[$user])) {
-            $stats[$user] = [
-                'user' => $user,
-                'wishes' => 0,
-                'wins' => 0,
-                'tokens' => 0,
-                'free_spins' => 0
-            ];
-        }
-
-        $stats[$user]['wishes']++;
-
-        if ($result === 'WIN' || $result === 'WISH_GRANTED') {
-            $stats[$user]['wins']++;
-        }
-        if ($result === 'TOKENS' || strpos($result, 'TOKENS_') !== false) {
-            $stats[$user]['tokens'] += $tokens;
-        }
-        if ($result === 'FREE_SPIN') {
-            $stats[$user]['free_spins']++;
-        }
+    foreach ($state['derived']['users'] as $user => $s) {
+        $stats[] = [
+            'user' => (string)$user,
+            'wishes' => $s['wishes'],
+            'wins' => $s['wins'],
+            'tokens' => $s['tokens'],
+            'free_spins' => $s['free_spins']
+        ];
     }
 
     // Sort by wins (primary), then tokens (secondary)
@@ -280,7 +351,7 @@ function getLeaderboard($file) {
     // Return top 3
     $top3 = array_slice(array_values($stats), 0, 3);
 
-    echo json_encode([
+    wireRespond([
         'success' => true,
         'leaderboard' => $top3,
         'log_url' => 'https://ndao.org/arcade/games/Zoltarano_Speaks/log.txt'
@@ -290,7 +361,7 @@ function getLeaderboard($file) {
 /**
  * Get stats for a specific user
  */
-function getStats($file, $user) {
+function getStats($file, $stateFile, $bloomFile, $user) {
     $user = sanitizeAccount($user);
 
     if (empty($user)) {
@@ -298,6 +369,13 @@ function getStats($file, $user) {
         return;
     }
 
+    wireRespond(['success' => true, 'stats' => userStats($file, $stateFile, $bloomFile, $user)]);
+}
+
+/**
+ * Stats of one user in one game partition
+ */
+function userStats($file, $stateFile, $bloomFile, $user) {
     $stats = [
         'user' => $user,
         'wishes' => 0,
@@ -307,38 +385,72 @@ function getStats($file, $user) {
         'losses' => 0
     ];
 
-    if (!file_exists($file)) {
-        echo json_encode(['success' => true, 'stats' => $stats]);
+    // Accounts the filter has never seen have empty stats; skip the log entirely
+    if (!file_exists($file) || bloomDefinitelyAbsent($bloomFile, $user)) {
+        return $stats;
+    }
+
+    $state = logCurrentState($file, $stateFile);
+
+    if (isset($state['derived']['users'][$user])) {
+        $stats = array_merge($stats, $state['derived']['users'][$user]);
+    }
+    return $stats;
+}
+
+/**
+ * Current manifest version; revalidated on every check, answered with 304 when unchanged
+ */
+function getConfigVersion($configFile) {
+    $version = gameConfig($configFile)['version'];
+    $etag = '"v' . $version . '"';
+    header('Cache-Control: no-cache');
+    header('ETag: ' . $etag);
+    if (trim($_SERVER['HTTP_IF_NONE_MATCH'] ?? '') === $etag) {
+        http_response_code(304);
         return;
     }
+    echo json_encode(['success' => true, 'version' => $version]);
+}
 
-    $lines = file($file, FILE_IGNORE_NEW_LINES | FILE_SKIP_EMPTY_LINES);
+/**
+ * The manifest itself; URLs naming the current version are cacheable forever
+ */
+function getConfig($configFile, $version) {
+    $config = gameConfig($configFile);
+    if ((string)$version === (string)$config['version']) {
+        header('Cache-Control: public, max-age=31536000, immutable');
+    } else {
+        header('Cache-Control: no-cache');
+    }
+    echo json_encode(['success' => true, 'version' => $config['version'], 'config' => $config]);
+}
 
-    foreach ($lines as $line) {
-        if (strpos($line, '#') === 0) continue;
-        if (strpos($line, $user) === false) continue;
-
-        $parts = array_map('trim', explode('|', $line));
-        if (count($parts) < 4) continue;
-        if ($parts[1] !== $user) continue;
-
-        $result = $parts[2];
-        $tokens = intval($parts[3]);
-
-        $stats['wishes']++;
-
-        if ($result === 'WIN' || $result === 'WISH_GRANTED') {
-            $stats['wins']++;
-        } elseif ($result === 'TOKENS' || strpos($result, 'TOKENS_') !== false) {
-            $stats['tokens'] += $tokens;
-        } elseif ($result === 'FREE_SPIN') {
-            $stats['free_spins']++;
-        } elseif ($result === 'LOSE' || $result === 'TRY_AGAIN') {
-            $stats['losses']++;
+/**
+ * Wallet-level stats: one user's totals across every game, plus the per-game breakdown
+ */
+function getWalletStats($dataDir, $user) {
+    $user = sanitizeAccount($user);
+
+    if (empty($user)) {
+        echo json_encode(['success' => false, 'error' => 'Invalid user']);
+        return;
+    }
+
+    $totals = ['user' => $user, 'wishes' => 0, 'wins' => 0, 'tokens' => 0, 'free_spins' => 0, 'losses' => 0];
+    $games = [];
+    foreach (gameTypes($dataDir) as $game) {
+        $paths = gamePaths($dataDir, $game);
+        $stats = userStats($paths['log'], $paths['state'], $paths['bloom'], $user);
+        foreach (['wishes', 'wins', 'tokens', 'free_spins', 'losses'] as $key) {
+            $totals[$key] += $stats[$key] ?? 0;
+        }
+        if ($stats['wishes'] > 0) {
+            $games[$game] = $stats;
         }
     }
 
-    echo json_encode(['success' => true, 'stats' => $stats]);
+    wireRespond(['success' => true, 'stats' => $totals, 'games' => $games]);
 }
 
 /**
@@ -348,7 +460,7 @@ function getRecentActivity($file) {
     $activity = [];
 
     if (!file_exists($file)) {
-        echo json_encode(['success' => true, 'activity' => []]);
+        wireRespond(['success' => true, 'activity' => []]);
         return;
     }
 
@@ -358,21 +470,206 @@ function getRecentActivity($file) {
     $count = 0;
     foreach ($lines as $line) {
         if ($count >= 10) break;
-        if (strpos($line, '#') === 0) continue;
 
-        $parts = array_map('trim', explode('|', $line));
-        if (count($parts) < 4) continue;
+        $rec = parseLogLine($line);
+        if ($rec === null) continue;
 
         $activity[] = [
-            'timestamp' => $parts[0],
-            'user' => $parts[1],
-            'result' => $parts[2],
-            'tokens' => intval($parts[3])
+            'timestamp' => $rec['timestamp'],
+            'user' => $rec['user'],
+            'result' => $rec['result'],
+            'tokens' => $rec['tokens']
         ];
         $count++;
     }
 
-    echo json_encode(['success' => true, 'activity' => $activity]);
+    wireRespond(['success' => true, 'activity' => $activity]);
+}
+
+/**
+ * Answer range / group-by queries over the hourly rollup cube
+ * Params: from, to (YYYY-MM, YYYY-MM-DD or YYYY-MM-DDTHH), group_by (hour, day, month, result, bucket)
+ */
+function getAnalytics($cubeDir, $params) {
+    $from = cubeHourBound($params['from'] ?? date('Y-m-d', strtotime('-6 days')), false);
+    $to = cubeHourBound($params['to'] ?? date('Y-m-d\TH'), true);
+    $groupBy = array_filter(explode(',', $params['group_by'] ?? 'day'));
+
+    if ($from === null || $to === null || $from > $to) {
+        echo json_encode(['success' => false, 'error' => 'Invalid range']);
+        return;
+    }
+    if (array_diff($groupBy, CUBE_DIMENSIONS)) {
+        echo json_encode(['success' => false, 'error' => 'Invalid group_by']);
+        return;
+    }
+
+    echo json_encode([
+        'success' => true,
+        'from' => $from,
+        'to' => $to,
+        'group_by' => array_values($groupBy),
+        'rows' => cubeQuery($cubeDir, $from, $to, array_values($groupBy))
+    ]);
+}
+
+/**
+ * Estimated distinct players over a window, optionally as a daily series
+ * Params: window (day, week, month) or from/to as for analytics; series=day
+ */
+function getActivePlayers($hllDir, $params) {
+    $windows = ['day' => 0, 'week' => 6, 'month' => 29];
+    $window = $params['window'] ?? null;
+
+    if ($window !== null) {
+        if (!isset($windows[$window])) {
+            echo json_encode(['success' => false, 'error' => 'Invalid window']);
+            return;
+        }
+        $from = date('Y-m-d', strtotime("-{$windows[$window]} days")) . 'T00';
+        $to = date('Y-m-d') . 'T23';
+    } else {
+        $from = cubeHourBound($params['from'] ?? date('Y-m-d'), false);
+        $to = cubeHourBound($params['to'] ?? date('Y-m-d'), true);
+    }
+
+    if ($from === null || $to === null || $from > $to) {
+        echo json_encode(['success' => false, 'error' => 'Invalid range']);
+        return;
+    }
+
+    list($sketch, $files) = hllWindow($hllDir, $from, $to);
+    $response = [
+        'success' => true,
+        'from' => $from,
+        'to' => $to,
+        'active_players' => hllEstimate($sketch),
+        'sketches' => $files
+    ];
+
+    if (($params['series'] ?? '') === 'day') {
+        $series = [];
+        for ($day = substr($from, 0, 10); $day <= substr($to, 0, 10); $day = date('Y-m-d', strtotime("$day +1 day"))) {
+            $series[$day] = hllEstimate(hllLoad("$hllDir/$day.hll"));
+        }
+        $response['series'] = $series;
+    }
+
+    echo json_encode($response);
+}
+
+/**
+ * Moderation search over private wishes
+ * Params: q ("a b" = AND, "OR", "-term" = NOT, "term*" = prefix), limit, cursor
+ */
+function searchWishes($wishDir, $params) {
+    $query = substr((string)($params['q'] ?? ''), 0, 200);
+    $limit = max(1, min(WISH_SEARCH_MAX_LIMIT, intval($params['limit'] ?? 50)));
+
+    if (!wishParseQuery($query)) {
+        echo json_encode(['success' => false, 'error' => 'Invalid query']);
+        return;
+    }
+
+    $cursor = wishDecodeCursor($params['cursor'] ?? null);
+    $page = wishSearch($wishDir, $query, $limit, isset($cursor['b']) ? (int)$cursor['b'] : null);
+
+    echo json_encode([
+        'success' => true,
+        'wishes' => $page['records'],
+        'next_cursor' => $page['next_before'] === null ? null : wishEncodeCursor(['b' => $page['next_before']])
+    ]);
+}
+
+/**
+ * Private history by account, IP or time range
+ * Params: by (user, ip, time), value (account or IP), from/to (time), limit, cursor
+ * Account and IP pages are newest first; time pages are oldest first
+ */
+function queryWishes($wishDir, $params) {
+    $by = $params['by'] ?? '';
+    $limit = max(1, min(WISH_SEARCH_MAX_LIMIT, intval($params['limit'] ?? 50)));
+    $cursor = wishDecodeCursor($params['cursor'] ?? null);
+
+    if ($by === 'user' || $by === 'ip') {
+        $key = $by === 'user' ? sanitizeAccount($params['value'] ?? '') : wishPackIp($params['value'] ?? '');
+        if (empty($key)) {
+            echo json_encode(['success' => false, 'error' => 'Invalid value']);
+            return;
+        }
+        if ($cursor !== null && (($cursor['k'] ?? '') !== $by || ($cursor['v'] ?? '') !== $key)) {
+            echo json_encode(['success' => false, 'error' => 'Invalid cursor']);
+            return;
+        }
+        $page = wishPostingPage($wishDir, $by, $key, $limit, $cursor['p'] ?? null);
+        $next = $page['next'] === null ? null : ['k' => $by, 'v' => $key, 'p' => $page['next']];
+    } elseif ($by === 'time') {
+        if ($cursor !== null) {
+            if (($cursor['k'] ?? '') !== 'time') {
+                echo json_encode(['success' => false, 'error' => 'Invalid cursor']);
+                return;
+            }
+            $from = $cursor['f'];
+            $to = $cursor['t'];
+        } else {
+            $fromTs = strtotime($params['from'] ?? '');
+            $toTs = isset($params['to']) ? strtotime($params['to']) : time();
+            if ($fromTs === false || $toTs === false) {
+                echo json_encode(['success' => false, 'error' => 'Invalid range']);
+                return;
+            }
+            $from = date('c', $fromTs);
+            $to = date('c', $toTs);
+        }
+        $page = wishTimePage($wishDir, $from, $to, $limit, $cursor === null ? null : [$cursor['s'], $cursor['o']]);
+        $next = $page['next'] === null ? null : ['k' => 'time', 'f' => $from, 't' => $to, 's' => $page['next'][0], 'o' => $page['next'][1]];
+    } else {
+        echo json_encode(['success' => false, 'error' => 'Invalid query']);
+        return;
+    }
+
+    echo json_encode([
+        'success' => true,
+        'wishes' => $page['records'],
+        'next_cursor' => wishEncodeCursor($next)
+    ]);
+}
+
+/**
+ * Stream results as NDJSON for offline analysis
+ * Params: source (log|wishes), from, to (timestamp prefixes, e.g. 2026-10 or 2026-10-01T12)
+ */
+function exportResults($logFile, $stateFile, $wishDir, $params) {
+    $source = $params['source'] ?? 'log';
+    $from = !empty($params['from']) ? (string)$params['from'] : null;
+    $to = !empty($params['to']) ? (string)$params['to'] : null;
+    if (!in_array($source, ['log', 'wishes'], true)) {
+        echo json_encode(['success' => false, 'error' => 'Invalid source']);
+        return;
+    }
+
+    header('Content-Type: application/x-ndjson');
+    header('Content-Disposition: attachment; filename="' . $source . '.ndjson"');
+    $out = fopen('php://output', 'wb');
+    if ($source === 'log') {
+        exportLogNdjson($logFile, $stateFile, $from, $to, $out);
+    } else {
+        exportWishesNdjson($wishDir, $from, $to, $out);
+    }
+    fclose($out);
+}
+
+/**
+ * Ship log bytes after a replica's offset (see lib/replication.php)
+ */
+function replicateLog($file, $params) {
+    $chunk = replRead($file, (int)($params['offset'] ?? 0));
+    if ($chunk === null) {
+        echo json_encode(['success' => false, 'error' => 'Log not found']);
+        return;
+    }
+    $chunk['data'] = base64_encode($chunk['data']);
+    echo json_encode(['success' => true] + $chunk);
 }
 
 /**